@@ -1,10 +1,15 @@
 import sys
+import queue
 import subprocess
+import threading
 from pathlib import Path
 from tqdm import tqdm
 
 TIMEOUT_SECONDS = 600.0
 
+# Marks the end of the solver's output in the line queue.
+END_OF_OUTPUT = None
+
 # ANSI colors for formatted output.
 class colors:
     HEADER = '\033[95m'
@@ -27,6 +32,32 @@ def format_time(us):
         return f"{us / 1_000:.3f} ms"
     return f"{int(us)} us" if us >= 1 else f"{us:.2f} us"
 
+def read_lines(stream, lines):
+    """Moves every line of a stream into a queue, then END_OF_OUTPUT."""
+    for line in stream:
+        lines.put(line)
+    lines.put(END_OF_OUTPUT)
+
+def read_result(lines, move_string, messages):
+    """Returns the solver's result line for a position, skipping informational messages.
+
+    Raises TimeoutExpired if no line arrives in time, and CalledProcessError if the solver
+    rejects the position or exits, since no result line would ever follow.
+    """
+    while True:
+        try:
+            line = lines.get(timeout=TIMEOUT_SECONDS)
+        except queue.Empty:
+            raise subprocess.TimeoutExpired(move_string, TIMEOUT_SECONDS)
+        if line is END_OF_OUTPUT:
+            raise subprocess.CalledProcessError(-1, move_string, stderr="".join(messages))
+        result = line.split()
+        if result and result[0] == move_string:
+            return result
+        messages.append(line)
+        if line.startswith("Error:"):
+            raise subprocess.CalledProcessError(1, move_string, stderr="".join(messages))
+
 def run_test_file(executable_path, test_file_path):
     if not test_file_path.is_file():
         print(f"\n{colors.FAIL}-> ERROR: Test file not found.{colors.ENDC}")
@@ -51,42 +82,69 @@ def run_test_file(executable_path, test_file_path):
 
         print()
         pbar_desc = f"{colors.BOLD}Suite: {test_file_path.name}{colors.ENDC}"
-        
+
+        # Solve the whole suite in a single batch-mode process so startup is paid only once.
+        # Its messages are merged into the output, which a thread drains so that neither
+        # pipe can fill up, and results are awaited with a timeout.
+        solver = subprocess.Popen(
+            [executable_path, "--batch"],
+            stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True
+        )
+        lines = queue.Queue()
+        messages = []
+        threading.Thread(target=read_lines, args=(solver.stdout, lines), daemon=True).start()
+
         for line_num, line in tqdm(test_cases, desc=pbar_desc, unit=" pos", ncols=100, file=sys.stdout):
             parts = line.strip().split()
             if len(parts) != 2:
                 print(f"\n{colors.FAIL}{'-'*10} PARSE ERROR {'-'*10}{colors.ENDC}")
                 print(f"Line {line_num}: Malformed line: '{line.strip()}'")
+                solver.kill()
                 return False
             
             move_string, expected_score_str = parts
             expected_score = int(expected_score_str)
 
-            result = subprocess.run(
-                [executable_path, move_string],
-                capture_output=True, text=True, check=True, timeout=TIMEOUT_SECONDS
-            )
+            try:
+                solver.stdin.write(move_string + "\n")
+                solver.stdin.flush()
+                result = read_result(lines, move_string, messages)
+            except (subprocess.TimeoutExpired, subprocess.CalledProcessError, BrokenPipeError):
+                solver.kill()
+                solver.wait()
+                raise
+            if len(result) != 6:
+                solver.kill()
+                raise subprocess.CalledProcessError(solver.wait(), executable_path, stderr="".join(messages))
 
-            actual_score, nodes, time_us = map(int, result.stdout.strip().split())
+            actual_score, nodes, time_us = map(int, result[3:])
 
             if actual_score != expected_score:
                 print(f"\n{colors.FAIL}{'-'*10} FAIL {'-'*10}{colors.ENDC}")
                 print(f"Position: '{move_string}'")
                 print(f"Line {line_num} - Expected: {expected_score}, Got: {actual_score}")
+                solver.kill()
                 return False
 
             total_passed += 1
             total_nodes += nodes
             total_time_us += time_us
 
+        solver.stdin.close()
+        solver.wait(timeout=TIMEOUT_SECONDS)
+
     except subprocess.TimeoutExpired:
         print(f"\n{colors.FAIL}{'-'*10} TIMEOUT {'-'*10}{colors.ENDC}")
         print(f"Position '{move_string}' on line {line_num} exceeded {TIMEOUT_SECONDS:.1f}s")
         return False
+    except BrokenPipeError:
+        print(f"\n{colors.FAIL}{'-'*10} C-PROGRAM EXITED {'-'*10}{colors.ENDC}")
+        print(f"Position: '{move_string}'")
+        return False
     except subprocess.CalledProcessError as e:
         print(f"\n{colors.FAIL}{'-'*5} C-PROGRAM FAILED (Code: {e.returncode}) {'-'*5}{colors.ENDC}")
         print(f"Position: '{move_string}'")
-        print(f"{colors.BOLD}C-program stderr:{colors.ENDC}\n{e.stderr.strip()}")
+        print(f"{colors.BOLD}C-program messages:{colors.ENDC}\n{(e.stderr or '').strip()}")
         return False
 
     # All tests in the file passed. Calculate and print summary statistics.
@@ -2,6 +2,7 @@
 #define BITBOARD_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <assert.h>
 
@@ -31,6 +32,22 @@ typedef struct {
     int moves;                 // Number of moves played in the game
 } GameState;
 
+// A position being searched, together with the cells where each player would complete
+// four in a row. The threat masks are updated as moves are played and undone, so the
+// search never recomputes them from scratch. They include occupied cells, which are
+// masked out when the threats are used.
+typedef struct {
+    GameState pos;
+    uint64_t threats;          // Cells that complete four for the current player
+    uint64_t opponent_threats; // Cells that complete four for the opponent
+} SearchState;
+
+// A mask representing the bottom row of the board.
+static const uint64_t BOTTOM_MASK = ((1ULL << (WIDTH * PHEIGHT)) - 1) / ((1ULL << PHEIGHT) - 1);
+
+// A mask representing all playable squares on the board.
+static const uint64_t BOARD_MASK = BOTTOM_MASK * ((1ULL << HEIGHT) - 1);
+
 
 // --- Public API ---
 
@@ -102,6 +119,18 @@ int move_score(const GameState* state, uint64_t move);
  */
 int bitboard_to_col(uint64_t move);
 
+/**
+ * @brief Sets up a position by playing a move string on an empty board.
+ * The engine assumes positions have no win for either player, so a string that
+ * contains a winning move is rejected like a malformed one.
+ * @param state Pointer to the GameState object receiving the position.
+ * @param moves The moves, as 1-indexed columns, e.g. "4453".
+ * @param message Buffer receiving the reason the string was rejected.
+ * @param size Size of the message buffer.
+ * @return NULL on success, or else message.
+ */
+const char* parse_moves(GameState* state, const char* moves, char* message, size_t size);
+
 /**
  * @brief Generates a unique 64-bit key for the current board position.
  * This key is used for the transposition table.
@@ -112,6 +141,35 @@ static inline uint64_t get_key(const GameState* state) {
     return state->current_position + state->mask;
 }
 
+/**
+ * @brief Mirrors a bitboard left to right, swapping column c with column WIDTH - 1 - c.
+ * Each column occupies PHEIGHT bits, so the mirror moves whole PHEIGHT-bit groups.
+ * @param board A bitboard, or a key built by adding bitboards.
+ * @return The mirrored bitboard.
+ */
+static inline uint64_t mirror_bitboard(uint64_t board) {
+    const uint64_t column_bits = (1ULL << PHEIGHT) - 1;
+    uint64_t mirrored = 0;
+    for (int col = 0; col < WIDTH; col++) { // Unrolled by the compiler for a fixed WIDTH.
+        mirrored |= ((board >> (col * PHEIGHT)) & column_bits) << ((WIDTH - 1 - col) * PHEIGHT);
+    }
+    return mirrored;
+}
+
+/**
+ * @brief Generates a key shared by a position and its mirror image.
+ * Mirrored positions have the same score, so they can share transposition table
+ * entries. Since a key never carries from one column into the next, mirroring the
+ * key is the same as computing the key of the mirrored position.
+ * @param state Pointer to the GameState object.
+ * @return The smaller of the position's key and its mirror's key.
+ */
+static inline uint64_t get_canonical_key(const GameState* state) {
+    uint64_t key = get_key(state);
+    uint64_t mirrored = mirror_bitboard(key);
+    return mirrored < key ? mirrored : key;
+}
+
 /**
  * @brief Creates a bitmask for all cells in a given column.
  * @param col The 0-indexed column.
@@ -128,4 +186,133 @@ static inline uint64_t column_mask(int col) {
  */
 uint64_t possible(const GameState* state);
 
+/**
+ * @brief Computes the cells where a player's stones would complete four in a row.
+ * @param position Bitmask of the player's stones.
+ * @return A bitmask of the completing cells, including cells that are already occupied.
+ */
+static inline uint64_t threat_cells(uint64_t position) {
+    // Vertical check
+    uint64_t r = (position << 1) & (position << 2) & (position << 3);
+
+    // Horizontal check
+    uint64_t p = (position << PHEIGHT) & (position << (2 * PHEIGHT));
+    r |= p & (position << (3 * PHEIGHT));
+    r |= p & (position >> PHEIGHT);
+    p = (position >> PHEIGHT) & (position >> (2 * PHEIGHT));
+    r |= p & (position << PHEIGHT);
+    r |= p & (position >> (3 * PHEIGHT));
+
+    // Diagonal (y = -x) check
+    p = (position << (PHEIGHT - 1)) & (position << (2 * (PHEIGHT - 1)));
+    r |= p & (position << (3 * (PHEIGHT - 1)));
+    r |= p & (position >> (PHEIGHT - 1));
+    p = (position >> (PHEIGHT - 1)) & (position >> (2 * (PHEIGHT - 1)));
+    r |= p & (position << (PHEIGHT - 1));
+    r |= p & (position >> (3 * (PHEIGHT - 1)));
+
+    // Diagonal (y = x) check
+    p = (position << (PHEIGHT + 1)) & (position << (2 * (PHEIGHT + 1)));
+    r |= p & (position << (3 * (PHEIGHT + 1)));
+    r |= p & (position >> (PHEIGHT + 1));
+    p = (position >> (PHEIGHT + 1)) & (position >> (2 * (PHEIGHT + 1)));
+    r |= p & (position << (PHEIGHT + 1));
+    r |= p & (position >> (3 * (PHEIGHT + 1)));
+
+    return r;
+}
+
+/**
+ * @brief Initializes a search state from a position, computing both threat masks.
+ * @param search Pointer to the SearchState to fill.
+ * @param state Pointer to the GameState object.
+ */
+void init_search_state(SearchState* search, const GameState* state);
+
+/**
+ * @brief Computes the current player's threats after playing a move.
+ * The result is what search_state_play() expects, so a move can be scored for
+ * ordering and then played without computing its threats twice.
+ * @param search Pointer to the SearchState object.
+ * @param move A bitmask representing the move.
+ * @return The current player's threat cells once the move is played.
+ */
+static inline uint64_t threats_after_move(const SearchState* search, uint64_t move) {
+    return threat_cells(search->pos.current_position | move);
+}
+
+/**
+ * @brief Computes the threats and threat counts of several candidate moves at once.
+ * Built with AVX2, the moves are processed four to a vector; otherwise one at a time.
+ * For each move, threats[i] equals threats_after_move() and scores[i] equals
+ * search_state_move_score().
+ * @param search Pointer to the SearchState object.
+ * @param moves The candidate moves, each a bitmask with a single bit set.
+ * @param count The number of moves, at most WIDTH.
+ * @param threats Receives the current player's threat cells after each move.
+ * @param scores Receives the number of empty threat cells after each move.
+ */
+void score_moves_batch(const SearchState* search, const uint64_t moves[WIDTH], int count,
+                       uint64_t threats[WIDTH], int scores[WIDTH]);
+
+/**
+ * @brief Plays a move in place and switches the perspective to the next player.
+ * @param search Pointer to the SearchState object.
+ * @param move A bitmask representing the move.
+ * @param mover_threats The mover's threats after the move, from threats_after_move().
+ */
+static inline void search_state_play(SearchState* search, uint64_t move, uint64_t mover_threats) {
+    search->pos.current_position ^= search->pos.mask;
+    search->pos.mask |= move;
+    search->pos.moves++;
+    search->threats = search->opponent_threats;
+    search->opponent_threats = mover_threats;
+}
+
+/**
+ * @brief Takes back a move played by search_state_play().
+ * @param search Pointer to the SearchState object.
+ * @param move The bitmask of the move to take back.
+ * @param mover_threats The mover's threats before the move was played.
+ */
+static inline void search_state_undo(SearchState* search, uint64_t move, uint64_t mover_threats) {
+    search->pos.mask ^= move;
+    search->pos.current_position ^= search->pos.mask;
+    search->pos.moves--;
+    search->opponent_threats = search->threats;
+    search->threats = mover_threats;
+}
+
+/**
+ * @brief Computes the moves that do not let the opponent win at once, from the
+ * maintained threat masks. Same result as possible_non_losing_moves().
+ * @param search Pointer to the SearchState object.
+ * @return A bitmask of non-losing moves.
+ */
+static inline uint64_t search_state_non_losing_moves(const SearchState* search) {
+    uint64_t possible_mask = (search->pos.mask + BOTTOM_MASK) & BOARD_MASK;
+    uint64_t opponent_win = search->opponent_threats & (BOARD_MASK ^ search->pos.mask);
+    uint64_t forced_moves = possible_mask & opponent_win;
+    if (forced_moves) {
+        if (forced_moves & (forced_moves - 1)) { // Opponent has more than one threat.
+            return 0; // Loss is unavoidable.
+        }
+        possible_mask = forced_moves; // Must play the single blocking move.
+    }
+    // Avoid playing directly below an opponent's winning spot.
+    return possible_mask & ~(opponent_win >> 1);
+}
+
+/**
+ * @brief Counts the threats the current player would have after a move, given the
+ * threats from threats_after_move(). Same result as move_score().
+ * @param search Pointer to the SearchState object.
+ * @param move A bitmask representing the move.
+ * @param mover_threats The mover's threats after the move.
+ * @return The number of empty cells that would complete four for the mover.
+ */
+static inline int search_state_move_score(const SearchState* search, uint64_t move, uint64_t mover_threats) {
+    return __builtin_popcountll(mover_threats & (BOARD_MASK ^ (search->pos.mask | move)));
+}
+
 #endif // BITBOARD_H
@@ -3,39 +3,132 @@
 
 #include "bitboard.h"
 #include <stdbool.h>
+#include <stddef.h>
 
-// Use GCC/Clang extension for 128-bit integers.
-typedef __uint128_t uint128_t;
-
-// The book will be used for positions with fewer moves than this value.
+// Default depth of the books written by bin/book_builder: they cover positions with
+// fewer moves than this value. Each book file records its own depth.
 #define MAX_BOOK_DEPTH 7
 
+// Score reported for positions and moves whose exact score the book does not hold.
+#define BOOK_NO_SCORE (MIN_SCORE - 1)
+
+// A loaded opening book. It is never modified after loading, so one book can be
+// shared read-only between any number of search threads.
+typedef struct {
+    const uint64_t* entries; // Packed entries in Eytzinger order, indexed from 1
+    const uint64_t* child_scores; // Packed move scores parallel to entries, or NULL if the book has none
+    size_t size;             // Number of entries
+    int depth;               // The book covers positions with fewer moves than this
+    void* storage;           // Memory holding the entries: a file mapping or a heap copy
+    size_t mapped_bytes;     // Size of the file mapping, or 0 if storage is on the heap
+} Book;
+
+// A position and its best move, used to write a book.
+typedef struct {
+    uint64_t key;             // Canonical position key, see book_canonical_key()
+    int move;                 // Best move (0-indexed column) in the canonical orientation
+    int score;                // Exact score of the position, or BOOK_NO_SCORE
+    int child_scores[WIDTH];  // Exact score of playing each column, or BOOK_NO_SCORE
+} BookRecord;
+
 /**
- * @brief Initializes the opening book by loading it from a file.
- * Must be called once at startup.
+ * @brief Loads an opening book from a file.
+ * Books in the current format are memory-mapped, so loading costs no copying.
+ * Books in the older format of packed 17-byte records are converted on load.
+ * @param book Pointer to the book to fill. It is left empty if the file cannot be loaded.
+ * @param filename Path of the book file.
+ * @return True if the book was loaded, false otherwise.
  */
-void init_book(void);
+bool book_load(Book* book, const char* filename);
 
 /**
- * @brief Frees memory allocated for the opening book.
+ * @brief Frees or unmaps the memory of a loaded book.
+ * @param book Pointer to the book.
  */
-void free_book(void);
+void book_free(Book* book);
+
+/**
+ * @brief Writes a book file in the current format.
+ * Records are sorted in place; for duplicate keys only the first record is kept.
+ * @param filename Path of the book file to create.
+ * @param records The positions and moves to store, keyed by canonical key.
+ * @param count The number of records.
+ * @param depth The book covers positions with fewer moves than this value.
+ * @param with_child_scores If true, the score of every move is stored as well.
+ * @return True if the book was written, false otherwise.
+ */
+bool book_write(const char* filename, BookRecord* records, size_t count, int depth, bool with_child_scores);
 
 /**
- * @brief Computes the unique 128-bit key for a given game state.
- * The key is a concatenation of the mask and the current player's position.
+ * @brief Computes the key under which a position is stored in the book.
+ * A position and its mirror image share one entry, stored under the smaller of their keys.
  * @param state Pointer to the GameState object.
- * @return The unique 128-bit key.
+ * @param mirrored Set to true if the canonical key is that of the mirrored position.
+ * @return The canonical 49-bit position key.
  */
-uint128_t book_compute_key(const GameState* state);
+uint64_t book_canonical_key(const GameState* state, bool* mirrored);
+
+/**
+ * @brief Retrieves the book move for a position, whichever orientation it is stored in.
+ * @param book Pointer to the book.
+ * @param state Pointer to the GameState object.
+ * @param move A pointer to an integer where the move, in the position's own orientation, will be stored.
+ * @return True if a move was found for the position, false otherwise.
+ */
+bool book_lookup_position(const Book* book, const GameState* state, int* move);
+
+/**
+ * @brief Retrieves the exact score of a position from the book.
+ * @param book Pointer to the book.
+ * @param state Pointer to the GameState object.
+ * @param score A pointer to an integer where the score will be stored.
+ * @return True if the book holds the position's score, false otherwise.
+ */
+bool book_lookup_score(const Book* book, const GameState* state, int* score);
+
+/**
+ * @brief Retrieves the exact score of every move of a position from the book.
+ * The scores are from the point of view of the player to move.
+ * @param book Pointer to the book.
+ * @param state Pointer to the GameState object.
+ * @param scores Receives the score of playing each column, or BOOK_NO_SCORE for
+ * columns that are full or not scored.
+ * @return True if the book holds move scores for the position, false otherwise.
+ */
+bool book_lookup_move_scores(const Book* book, const GameState* state, int scores[WIDTH]);
+
+/**
+ * @brief Retrieves a move from a book for a given canonical key.
+ * Searches the Eytzinger-ordered entries, whose first levels share a few cache lines.
+ * @param book Pointer to the book.
+ * @param key The canonical position key.
+ * @param move A pointer to an integer where the move will be stored.
+ * @return True if a move was found for the key, false otherwise.
+ */
+bool book_lookup(const Book* book, uint64_t key, int* move);
+
+/**
+ * @brief Returns the process-wide book loaded by init_book().
+ */
+const Book* default_book(void);
+
+/**
+ * @brief Initializes the default opening book by loading it from "book.bin".
+ * Must be called once at startup.
+ */
+void init_book(void);
+
+/**
+ * @brief Frees memory allocated for the default opening book.
+ */
+void free_book(void);
 
 /**
- * @brief Retrieves a move from the opening book for a given key.
- * Uses binary search on the loaded book data.
- * @param key The 128-bit position key.
+ * @brief Retrieves a move from the default opening book for a given canonical key.
+ * @param key The canonical position key.
  * @param move A pointer to an integer where the move will be stored.
  * @return True if a move was found for the key, false otherwise.
  */
-bool book_get_move(uint128_t key, int* move);
+bool book_get_move(uint64_t key, int* move);
 
-#endif // BOOK_H
\ No newline at end of file
+#endif // BOOK_H
@@ -0,0 +1,113 @@
+#ifndef C4SOLVER_H
+#define C4SOLVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The embeddable interface of libc4solver. Every solver owns its transposition table
+// and counters, so threads can each use their own solver without any locking. Books
+// are read-only once loaded and can be shared by any number of solvers and threads.
+// This header does not depend on the engine's internal headers.
+
+#if defined(__GNUC__)
+#define C4_API __attribute__((visibility("default")))
+#else
+#define C4_API
+#endif
+
+// Number of columns of the board.
+#define C4_WIDTH 7
+// Score reported by c4_best_move() for columns that cannot be played.
+#define C4_INVALID_SCORE (-19)
+
+// Result of a library call.
+typedef enum {
+    C4_OK = 0,
+    C4_INVALID_POSITION, // The move string is malformed, fills a column past the top or contains a win
+    C4_NO_MOVE,          // The board is full, so there is no move to find
+} C4Status;
+
+// A loaded opening book.
+typedef struct C4Book C4Book;
+
+// A solver with its own transposition table.
+typedef struct C4Solver C4Solver;
+
+// Options of c4_solver_new(). Zero-initialized options select the defaults.
+typedef struct {
+    size_t table_mb;     // Size of the transposition table in megabytes, or 0 for 64
+    const C4Book* book;  // Book consulted by the solver, or NULL for none
+} C4SolverOptions;
+
+/**
+ * @brief Loads an opening book written by book_builder.
+ * The book can be given to any number of solvers, which only read it.
+ * @param filename Path of the book file.
+ * @return The book, or NULL if the file could not be loaded.
+ */
+C4_API C4Book* c4_book_load(const char* filename);
+
+/**
+ * @brief Frees a book. Every solver using it must have been freed first.
+ * @param book The book, or NULL.
+ */
+C4_API void c4_book_free(C4Book* book);
+
+/**
+ * @brief Creates a solver with an empty transposition table.
+ * Aborts if the table cannot be allocated, as the engine does.
+ * @param options The options, or NULL for the defaults.
+ * @return The solver.
+ */
+C4_API C4Solver* c4_solver_new(const C4SolverOptions* options);
+
+/**
+ * @brief Frees a solver and its table.
+ * @param solver The solver, or NULL.
+ */
+C4_API void c4_free(C4Solver* solver);
+
+/**
+ * @brief Forgets every position stored in the solver's table.
+ * Entries are otherwise kept between calls, so related positions, such as the
+ * successive positions of one game, reuse each other's work.
+ * @param solver The solver.
+ */
+C4_API void c4_clear(C4Solver* solver);
+
+/**
+ * @brief Solves a position.
+ * @param solver The solver.
+ * @param moves The moves played from the empty board, as 1-indexed columns, e.g. "4453".
+ * @param weak If true, only finds whether the position is won, drawn or lost.
+ * @param score Receives the score for the player to move: positive for a win, 0 for a
+ * draw and negative for a loss, as in bin/solver, or 1, 0 or -1 for a weak solve.
+ * @return C4_OK, or C4_INVALID_POSITION.
+ */
+C4_API C4Status c4_solve(C4Solver* solver, const char* moves, bool weak, int* score);
+
+/**
+ * @brief Finds the best move in a position, and optionally the score of every move.
+ * @param solver The solver.
+ * @param moves The moves played from the empty board, as for c4_solve().
+ * @param column Receives the 0-indexed column of the best move.
+ * @param scores Receives the score of playing each column, or C4_INVALID_SCORE for full
+ * columns. May be NULL, which makes the search cheaper.
+ * @return C4_OK, C4_INVALID_POSITION, or C4_NO_MOVE if the board is full.
+ */
+C4_API C4Status c4_best_move(C4Solver* solver, const char* moves, int* column, int scores[C4_WIDTH]);
+
+/**
+ * @brief Returns the number of nodes searched by the solver's last call.
+ * @param solver The solver.
+ */
+C4_API uint64_t c4_nodes(const C4Solver* solver);
+
+/**
+ * @brief Returns a short description of a status.
+ * @param status The status.
+ */
+C4_API const char* c4_status_string(C4Status status);
+
+#endif // C4SOLVER_H
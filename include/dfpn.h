@@ -0,0 +1,75 @@
+#ifndef DFPN_H
+#define DFPN_H
+
+#include "bitboard.h"
+#include "book.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Smallest proof-number table in megabytes.
+#define MIN_DFPN_TABLE_MB 1
+
+// A transposition table of proof and disproof numbers. Each 16-byte entry holds a full
+// position key, so entries are never confused, together with the amount of work that
+// produced it. Four entries share a cache line, and when all four are taken the one
+// with the least work is replaced, so the table never grows beyond its allocation.
+// Entries record the generation that wrote them, which makes clearing the table a
+// counter increment.
+typedef struct {
+    struct DfpnBucket* buckets; // Cache-line-aligned buckets
+    size_t num_buckets;         // Number of buckets, a power of two
+    int index_shift;            // Right shift turning a hashed key into a bucket index
+    bool mapped;                // True if the buckets were allocated with mmap
+    unsigned generation;        // Entries of other generations are empty
+} DfpnTable;
+
+// The state of one proof-number search. Contexts with their own tables can search concurrently.
+typedef struct {
+    DfpnTable* table;        // Table used by this context
+    const Book* book;        // Opening book consulted for exact scores, or NULL for none
+    uint64_t nodes;          // Nodes expanded by this context
+    int column_order[WIDTH]; // Column order used to break ties between moves
+} DfpnContext;
+
+/**
+ * @brief Allocates a proof-number table and clears it.
+ * The size is rounded down to a power of two, and up to MIN_DFPN_TABLE_MB.
+ * @param table Pointer to the table to initialize.
+ * @param size_mb The size of the table in megabytes.
+ */
+void dfpn_table_init(DfpnTable* table, size_t size_mb);
+
+/**
+ * @brief Clears all entries in a proof-number table by starting a new generation.
+ * @param table Pointer to the table.
+ */
+void dfpn_table_reset(DfpnTable* table);
+
+/**
+ * @brief Frees the memory used by a proof-number table.
+ * @param table Pointer to the table.
+ */
+void dfpn_table_free(DfpnTable* table);
+
+/**
+ * @brief Initializes a proof-number search context with the center-first move order.
+ * @param ctx Pointer to the context.
+ * @param table The table the context searches with.
+ * @param book The opening book consulted by the search, or NULL for none.
+ */
+void init_dfpn_context(DfpnContext* ctx, DfpnTable* table, const Book* book);
+
+/**
+ * @brief Finds whether a position is won, drawn or lost with depth-first proof-number search.
+ * Proves or disproves that the player to move can win, and then that they can avoid
+ * losing. The search always expands the position that is cheapest to resolve, so it
+ * suits positions with an unbalanced game tree. The context's node counter is increased
+ * by the nodes expanded.
+ * @param ctx Pointer to the search context.
+ * @param state A constant pointer to the game state to solve.
+ * @return WEAK_WIN, WEAK_DRAW or WEAK_LOSS for the player to move.
+ */
+int dfpn_solve_in_context(DfpnContext* ctx, const GameState* state);
+
+#endif // DFPN_H
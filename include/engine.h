@@ -2,12 +2,66 @@
 #define ENGINE_H
 
 #include "bitboard.h"
+#include "table.h"
+#include "book.h"
+#include "ordering.h"
+#include <limits.h>
 
-// Global counter for the number of nodes searched by the solver.
+// Score reported by score_moves() for columns that cannot be played.
+#define INVALID_MOVE_SCORE (MIN_SCORE - 1)
+
+// Passed as the guess to solve_with_guess() when there is none.
+#define NO_SCORE_GUESS INT_MIN
+
+// Global counter for the number of nodes searched by solve() and find_best_move(),
+// summed over all search threads.
 extern uint64_t g_nodes_searched;
 
+// Global counter for the null-window re-searches of solve() and find_best_move(): every
+// null-window search after the first one that a score search needed.
+extern uint64_t g_researches;
+
+// How a search narrows down the score of a position with null-window searches.
+typedef enum {
+    SEARCH_BISECTION, // Binary search of the score range, with the pivot biased toward 0
+    SEARCH_MTDF,      // MTD(f): repeatedly test the last result, starting from a guess
+} SearchDriver;
+
+// The complete state of one search thread. Contexts never share mutable state
+// except through the table they point at, so independent contexts with their
+// own tables can search different positions concurrently.
+typedef struct {
+    TransTable* table;        // Transposition table used by this context
+    const Book* book;         // Opening book of moves and exact scores, or NULL for none
+    uint64_t nodes;           // Nodes searched by this context
+    int column_order[WIDTH];  // Column exploration order
+    bool unbiased_pivot;      // Use the plain midpoint when binary searching the score
+    SearchDriver driver;      // How the score is narrowed down
+    uint64_t researches;      // Null-window re-searches made by this context
+    bool dynamic_ordering;    // Adjust the move order with killer moves and history
+    OrderingHistory ordering; // Killer moves and history learned from this context's cutoffs
+    bool* stop;               // Flag telling the context to abandon its search
+    uint64_t node_limit;      // The context stops itself once nodes reaches this
+    long long deadline_us;    // Monotonic time at which the context stops itself, or 0 for none
+    uint64_t next_check;      // Value of nodes at which the limits are next checked
+} SearchContext;
+
+// Budget of an anytime search. A zero field sets no limit.
+typedef struct {
+    long long time_us; // Wall-clock time, in microseconds
+    uint64_t nodes;    // Nodes searched
+} SearchLimits;
+
+// Outcome of an anytime search.
+typedef struct {
+    int move;       // The 0-indexed column chosen, or -1 if no move is possible
+    bool exact;     // True if the move was proven best by the book or an exact search
+    int depth;      // Depth of the deepest heuristic search completed, in plies
+    uint64_t nodes; // Nodes searched
+} AnytimeResult;
+
 /**
- * @brief Initializes the solver's internal state (e.g., column exploration order).
+ * @brief Initializes the solver's internal state and loads the default opening book.
  * Must be called once at startup.
  */
 void init_solver(void);
@@ -17,8 +71,53 @@ void init_solver(void);
  */
 void reset_solver(void);
 
+/**
+ * @brief Sets the number of threads used to search a single position.
+ * With more than one thread, all threads search the same position and share the
+ * transposition table (Lazy SMP); the first one to finish provides the result.
+ * @param threads The number of threads. Values below 1 are treated as 1.
+ */
+void set_search_threads(int threads);
+
+/**
+ * @brief Sets whether new search contexts order moves with killer moves and history.
+ * Off by default: on the benchmark suites the heuristics save nodes on some positions
+ * but cost more on the hardest ones.
+ * @param enabled True to enable the dynamic heuristics.
+ */
+void set_dynamic_ordering(bool enabled);
+
+/**
+ * @brief Sets how new search contexts narrow down the score of a position.
+ * SEARCH_BISECTION is the default. SEARCH_MTDF starts from a guess of the score, taken
+ * from the caller or else the position's table entry, and needs only two null-window
+ * searches when the guess is right. Without either guess it falls back to bisection,
+ * since from a poor guess its fail-soft steps can take many more searches.
+ * @param driver The search driver.
+ */
+void set_search_driver(SearchDriver driver);
+
+/**
+ * @brief Initializes a search context with the standard center-first move order.
+ * @param ctx Pointer to the context.
+ * @param table The transposition table the context searches with.
+ * @param book The opening book consulted by the search, or NULL for none.
+ */
+void init_search_context(SearchContext* ctx, TransTable* table, const Book* book);
+
+/**
+ * @brief Limits the searches of a context from now on. Once the budget is spent, the
+ * context sets its stop flag, so the search in progress returns early with a
+ * meaningless result. find_best_move_within_context() replaces these limits.
+ * @param ctx Pointer to the context.
+ * @param limits The budget, shared by every search until the limits are set again, or
+ * NULL for none.
+ */
+void set_search_limits(SearchContext* ctx, const SearchLimits* limits);
+
 /**
  * @brief Solves the given Connect4 position.
+ * Uses the default table and book, and the number of threads set by set_search_threads().
  * @param state A constant pointer to the game state to solve.
  * @param weak If true, performs a weak solve (only determines win/loss/draw, not score).
  * @return The score of the position. Positive for a win, negative for a loss, 0 for a draw.
@@ -26,8 +125,96 @@ void reset_solver(void);
  */
 int solve(const GameState* state, bool weak);
 
+/**
+ * @brief Solves the given position, starting from a guess of its score.
+ * Same as solve(), except that the MTD(f) driver starts from the guess instead of the
+ * position's table entry. A good guess is the score of a closely related position,
+ * such as the previous one in an analysis. The bisection driver ignores it.
+ * @param state A constant pointer to the game state to solve.
+ * @param weak If true, performs a weak solve (only determines win/loss/draw, not score).
+ * @param guess The expected score, or NO_SCORE_GUESS.
+ * @return The score of the position, as for solve().
+ */
+int solve_with_guess(const GameState* state, bool weak, int guess);
+
+/**
+ * @brief Solves the given position on the calling thread with an explicit context.
+ * The context's node counter is increased by the number of nodes searched.
+ * @param ctx Pointer to the search context.
+ * @param state A constant pointer to the game state to solve.
+ * @param weak If true, performs a weak solve (only determines win/loss/draw, not score).
+ * @return The score of the position, as for solve().
+ */
+int solve_in_context(SearchContext* ctx, const GameState* state, bool weak);
 
+/**
+ * @brief Solves the given position with an explicit context, starting from a guess.
+ * @param ctx Pointer to the search context.
+ * @param state A constant pointer to the game state to solve.
+ * @param weak If true, performs a weak solve (only determines win/loss/draw, not score).
+ * @param guess The expected score, or NO_SCORE_GUESS.
+ * @return The score of the position, as for solve().
+ */
+int solve_in_context_with_guess(SearchContext* ctx, const GameState* state, bool weak, int guess);
+
+/**
+ * @brief Finds the best move for the current player.
+ * Uses the default book, table and number of search threads. All moves are searched
+ * together: after the first, a move is solved exactly only if it beats the best so far.
+ * @param state A constant pointer to the game state.
+ * @return The 0-indexed column of the best move, or -1 if no move is possible.
+ */
 int find_best_move(const GameState* state);
 
+/**
+ * @brief Finds the best move for the current player with an explicit context.
+ * @param ctx Pointer to the search context.
+ * @param state A constant pointer to the game state.
+ * @return The 0-indexed column of the best move, or -1 if no move is possible.
+ */
+int find_best_move_in_context(SearchContext* ctx, const GameState* state);
+
+/**
+ * @brief Finds a move within a time or node budget, proven best if the budget allows.
+ * The budget is split between two searches. A quarter goes to iterative deepening with
+ * a heuristic evaluation of the threats each player has at the horizon, which always
+ * provides a move. The rest goes to an exact search, whose move replaces the heuristic
+ * one if it finishes in time. Uses the default book and table, on the calling thread.
+ * @param state A constant pointer to the game state.
+ * @param limits The budget. Without any limit, the search is exact, as find_best_move().
+ * @param result Receives the move and how it was found.
+ * @return The 0-indexed column of the move, or -1 if no move is possible.
+ */
+int find_best_move_within(const GameState* state, const SearchLimits* limits, AnytimeResult* result);
+
+/**
+ * @brief Finds a move within a time or node budget with an explicit context.
+ * @param ctx Pointer to the search context.
+ * @param state A constant pointer to the game state.
+ * @param limits The budget, as for find_best_move_within().
+ * @param result Receives the move and how it was found.
+ * @return The 0-indexed column of the move, or -1 if no move is possible.
+ */
+int find_best_move_within_context(SearchContext* ctx, const GameState* state, const SearchLimits* limits,
+                                  AnytimeResult* result);
+
+/**
+ * @brief Finds the best move for the current player and the exact score of every move.
+ * Uses the default book, table and number of search threads.
+ * @param state A constant pointer to the game state.
+ * @param scores Receives the score of playing each column, from the current player's
+ * point of view, or INVALID_MOVE_SCORE for full columns.
+ * @return The 0-indexed column of the best move, or -1 if no move is possible.
+ */
+int score_moves(const GameState* state, int scores[WIDTH]);
+
+/**
+ * @brief Finds the best move and the exact score of every move with an explicit context.
+ * @param ctx Pointer to the search context.
+ * @param state A constant pointer to the game state.
+ * @param scores Receives the score of each column, as for score_moves().
+ * @return The 0-indexed column of the best move, or -1 if no move is possible.
+ */
+int score_moves_in_context(SearchContext* ctx, const GameState* state, int scores[WIDTH]);
 
 #endif // ENGINE_H
@@ -31,4 +31,55 @@ void sorter_add(MoveSorter* sorter, uint64_t move, int score);
  */
 uint64_t sorter_get_next(MoveSorter* sorter);
 
+// Number of plies covered by the killer move table.
+#define MAX_PLY (WIDTH * HEIGHT)
+// Number of killer moves remembered per ply.
+#define NUM_KILLERS 2
+
+// Move-ordering knowledge learned from the beta cutoffs of a search: per-ply killer
+// columns and a per-player history of the cells whose moves caused cutoffs. Each
+// search context owns one, so threads never share it.
+typedef struct {
+    int8_t killers[MAX_PLY][NUM_KILLERS];  // Recent cutoff columns per ply, most recent first, or -1
+    uint32_t history[2][WIDTH * PHEIGHT];  // Cutoff weight per player and cell
+} OrderingHistory;
+
+/**
+ * @brief Forgets all killer moves and history.
+ */
+void history_reset(OrderingHistory* history);
+
+/**
+ * @brief Scores a move for the sorter, combining its threat count with the dynamic heuristics.
+ * Moves creating more threats always come first. Among the others, the static column
+ * order is adjusted by the killer moves of the ply and the history of the move's cell.
+ * @param history Pointer to the ordering history.
+ * @param ply Number of moves played in the position.
+ * @param move The move as a bitboard with a single bit set.
+ * @param threats The move's threat count from move_score().
+ * @param rank The move's column rank in the static order, 0 for the first column tried.
+ * @return The sorter score of the move.
+ */
+static inline int history_move_score(const OrderingHistory* history, int ply, uint64_t move, int threats,
+                                     int rank) {
+    // The threat count dominates. Below it, each step towards the center of the static
+    // order is worth a rank weight, and a killer or a large history weight can overturn
+    // at most a couple of those steps: letting dynamic heuristics override the
+    // center-first order outright costs more nodes than it saves on the benchmark suites.
+    const int threats_shift = 20, rank_weight = 1 << 15, killer_weight = 1 << 12, history_shift = 2;
+    int col = bitboard_to_col(move);
+    int killer = history->killers[ply][0] == col ? 2 : history->killers[ply][1] == col ? 1 : 0;
+    uint32_t weight = history->history[ply & 1][__builtin_ctzll(move)];
+    return (threats << threats_shift) + (WIDTH - 1 - rank) * rank_weight + killer * killer_weight +
+           (int)(weight >> history_shift);
+}
+
+/**
+ * @brief Records a move that caused a beta cutoff.
+ * @param history Pointer to the ordering history.
+ * @param ply Number of moves played in the position.
+ * @param move The cutoff move as a bitboard with a single bit set.
+ */
+void history_record_cutoff(OrderingHistory* history, int ply, uint64_t move);
+
 #endif // ORDERING_H
@@ -14,6 +14,7 @@ typedef enum {
 typedef struct {
     PlayerType type;
     char symbol; 
+    SearchLimits limits; // Budget of each AI move; without limits the AI plays perfectly
 } Player;
 
 /**
@@ -0,0 +1,48 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "bitboard.h"
+#include <stddef.h>
+
+// How the pool's workers solve positions.
+typedef enum {
+    SOLVE_EXACT, // Exact scores, with the alpha-beta engine
+    SOLVE_WEAK,  // Win, draw or loss only, with the weak solver
+    SOLVE_DFPN,  // Win, draw or loss only, with depth-first proof-number search
+} SolveMode;
+
+// A position to be solved by the pool, together with its result.
+typedef struct {
+    GameState state;   // The position to solve
+    int score;         // The solved score
+    uint64_t nodes;    // Nodes searched to solve the position
+    long long time_us; // Wall-clock time taken, in microseconds
+} SolveJob;
+
+/**
+ * @brief Called once per job, in input order, when its result is available.
+ * @param job The solved job.
+ * @param index The index of the job in the input array.
+ * @param user_data The pointer given to solve_jobs().
+ */
+typedef void (*SolveJobCallback)(const SolveJob* job, size_t index, void* user_data);
+
+/**
+ * @brief Solves independent positions in parallel on a pool of worker threads.
+ * Each worker owns its transposition table and search context and takes the next
+ * unsolved job whenever it finishes one. Results are reported through the callback
+ * on the calling thread in input order, as soon as every earlier job is done.
+ * Workers consult the default book. init_solver() must have been called first.
+ * @param jobs The positions to solve. Results are written back into the array.
+ * @param count The number of jobs.
+ * @param num_workers The number of worker threads.
+ * @param table_mb The size of each worker's transposition table in megabytes.
+ * @param mode How positions are solved. Weak modes only determine win/loss/draw, and
+ * table_mb sizes the table of the solver they use instead.
+ * @param on_done Callback invoked for every job in order, or NULL.
+ * @param user_data Pointer passed through to the callback.
+ */
+void solve_jobs(SolveJob* jobs, size_t count, int num_workers, size_t table_mb, SolveMode mode,
+                SolveJobCallback on_done, void* user_data);
+
+#endif // POOL_H
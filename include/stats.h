@@ -0,0 +1,81 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "bitboard.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Search instrumentation. Builds with SEARCH_STATS defined (make STATS=1) count what
+// the search does; in other builds the counting macros expand to nothing, so the
+// counters cost nothing.
+
+// Number of plies the per-ply counters cover: every number of moves played.
+#define STATS_PLIES (WIDTH * HEIGHT + 1)
+
+// Counters of the exact search, kept per thread.
+typedef struct {
+    uint64_t nodes;                         // Positions searched by negamax
+    uint64_t nodes_by_ply[STATS_PLIES];     // Positions searched, by number of moves played
+    uint64_t cutoffs;                       // Beta cutoffs in the move loop
+    uint64_t cutoffs_by_ply[STATS_PLIES];   // Beta cutoffs, by number of moves played
+    uint64_t cutoffs_by_index[WIDTH];       // Beta cutoffs, by position of the move in the search order
+    uint64_t tt_probes;                     // Calls to table_get()
+    uint64_t tt_hits;                       // Probes that found the position
+    uint64_t tt_cutoffs;                    // Nodes ended by a stored bound
+    uint64_t tt_stores;                     // Calls to table_put() that wrote an entry
+    uint64_t tt_overwrites;                 // Stores that evicted another visible position
+    uint64_t etc_cutoffs;                   // Nodes ended by an enhanced transposition cutoff
+    uint64_t book_hits;                     // Nodes ended by an exact score from the book
+    uint64_t researches;                    // Null-window searches after the first of a solve
+} SearchStats;
+
+#ifdef SEARCH_STATS
+
+// The counters of the calling thread.
+extern __thread SearchStats g_search_stats;
+
+// Adds n to a counter of the calling thread, e.g. STATS_ADD(nodes_by_ply[ply], 1).
+#define STATS_ADD(field, n) (g_search_stats.field += (uint64_t)(n))
+
+#else
+
+#define STATS_ADD(field, n) ((void)0)
+
+#endif // SEARCH_STATS
+
+// Adds one to a counter of the calling thread.
+#define STATS_INC(field) STATS_ADD(field, 1)
+
+/**
+ * @brief Returns true if the build counts search statistics.
+ */
+bool stats_enabled(void);
+
+/**
+ * @brief Sets every counter of the calling thread to zero.
+ */
+void stats_reset(void);
+
+/**
+ * @brief Returns a copy of the calling thread's counters.
+ * In builds without statistics, every counter is zero.
+ */
+SearchStats stats_current(void);
+
+/**
+ * @brief Adds counters, such as those of a finished helper thread, to the calling thread's.
+ * Does nothing in builds without statistics.
+ * @param from The statistics to add.
+ */
+void stats_add(const SearchStats* from);
+
+/**
+ * @brief Writes statistics as one line of JSON.
+ * Per-ply arrays stop at the last ply with a non-zero count.
+ * @param out The stream to write to.
+ * @param position The position's move string, recorded in the object, or NULL.
+ * @param stats The statistics to write.
+ */
+void stats_write_json(FILE* out, const char* position, const SearchStats* stats);
+
+#endif // STATS_H
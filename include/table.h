@@ -2,34 +2,189 @@
 #define TABLE_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Default size of a transposition table in megabytes.
+#define DEFAULT_TABLE_MB 64
+
+// A transposition table. Each search context points at one; a table can be
+// owned by a single thread or shared between the threads searching one position.
+// Entries are grouped into buckets that each fill exactly one 64-byte cache line.
+typedef struct {
+    struct TableBucket* buckets; // Cache-line-aligned buckets
+    size_t num_buckets;          // Number of buckets, a power of two
+    int index_shift;             // Right shift turning a hashed key into a bucket index
+    bool mapped;                 // True if the buckets were allocated with mmap
+    size_t map_offset;           // Offset of the buckets within their mapping
+    bool read_only;              // True if stores are ignored (read-only snapshot)
+    int reset_threads;           // Number of threads used to clear the table
+    unsigned generation;         // Generation stored in new entries, see table_reset()
+    unsigned visible_generations; // Entries of this many generations, counting the current one, are visible
+} TransTable;
 
 /**
- * @brief Allocates memory for the transposition table. Must be called once at startup.
+ * @brief Allocates memory for a transposition table and clears it.
+ * The size is rounded down to a power of two. Tables of at least one huge page are
+ * backed by huge pages where the system supports them, falling back to normal pages.
+ * @param table Pointer to the table to initialize.
+ * @param size_mb The size of the table in megabytes.
  */
-void init_table(void);
+void table_init(TransTable* table, size_t size_mb);
 
 /**
- * @brief Clears all entries in the transposition table.
+ * @brief Writes a snapshot of a table to a file.
+ * The file starts with a header recording the board size, score range and table
+ * size, followed by the table's buckets exactly as they are laid out in memory.
+ * @param table Pointer to the table.
+ * @param filename Path of the snapshot file to create.
+ * @return True if the snapshot was written, false otherwise.
  */
-void reset_table(void);
+bool table_save(const TransTable* table, const char* filename);
 
 /**
- * @brief Frees the memory used by the transposition table. Must be called once at exit.
+ * @brief Initializes a table by memory-mapping a snapshot written by table_save().
+ * The table takes the size recorded in the snapshot. Changes are never written back
+ * to the file: a copy-on-write table keeps them in private memory, and a read-only
+ * table ignores stores altogether and must not be reset.
+ * @param table Pointer to the table to initialize.
+ * @param filename Path of the snapshot file.
+ * @param read_only If true, map the snapshot read-only instead of copy-on-write.
+ * @return True if the snapshot was loaded, false if it is missing or incompatible.
  */
-void free_table(void);
+bool table_load(TransTable* table, const char* filename, bool read_only);
+
+/**
+ * @brief Sets the number of threads used to clear a large table.
+ * Tables are only cleared for real when table_reset() or table_age() has used up
+ * the generations that entries can be tagged with.
+ * @param table Pointer to the table.
+ * @param threads The number of threads. Values below 1 are treated as 1.
+ */
+void table_set_reset_threads(TransTable* table, int threads);
+
+/**
+ * @brief Returns the size of a table's storage in bytes.
+ * @param table Pointer to the table.
+ */
+size_t table_bytes(const TransTable* table);
+
+/**
+ * @brief Clears all entries in a transposition table.
+ * Entries are tagged with the generation that stored them, so clearing only starts
+ * a new generation and hides the older entries, which are replaced first. The
+ * memory is cleared for real once every 64 generations.
+ * @param table Pointer to the table.
+ */
+void table_reset(TransTable* table);
+
+/**
+ * @brief Starts a new generation without hiding the entries of earlier ones.
+ * Entries stay usable by later searches, but when a bucket is full the entries of
+ * older generations are replaced before those of newer ones. Use this between
+ * searches of related positions, such as successive moves of one game.
+ * @param table Pointer to the table.
+ */
+void table_age(TransTable* table);
+
+/**
+ * @brief Frees the memory used by a transposition table.
+ * @param table Pointer to the table.
+ */
+void table_free(TransTable* table);
+
+/**
+ * @brief Allocates zeroed, cache-line-aligned storage for a table of any layout.
+ * Storage of at least one huge page is backed by huge pages where the system
+ * supports them.
+ * @param bytes The size of the storage in bytes.
+ * @param mapped Set to true if the storage was mapped rather than allocated on the heap.
+ * @return The storage, to be released with table_free_memory(), or NULL if it could not be allocated.
+ */
+void* table_alloc_memory(size_t bytes, bool* mapped);
+
+/**
+ * @brief Sets whether table storage is faulted in as soon as it is allocated.
+ * By default, mapped storage is only backed by memory when it is first used, so the
+ * first searches with a new table also pay for the kernel zeroing its pages. Faulting
+ * it in up front gives steady timings from the first position, at the cost of touching
+ * all of the table even if a search only needs part of it. Applies to every table
+ * allocated afterwards.
+ * @param enabled True to fault in new tables when they are allocated.
+ */
+void set_table_prefault(bool enabled);
+
+/**
+ * @brief Frees storage allocated by table_alloc_memory().
+ * @param memory The storage.
+ * @param bytes The size of the storage in bytes.
+ * @param mapped The value table_alloc_memory() set for the storage.
+ */
+void table_free_memory(void* memory, size_t bytes, bool mapped);
 
 /**
- * @brief Stores a value for a given key in the table.
+ * @brief Stores a value and best move for a given key in the table.
+ * If the key's bucket is full, a hidden entry is replaced, or else one of the oldest
+ * generation, and among those the entry of the deepest position (the one with the
+ * most moves played, hence the smallest subtree).
+ * Safe to call concurrently with other table_put/table_get calls on the same table.
+ * @param table Pointer to the table.
  * @param key The 64-bit position key.
  * @param value The encoded score value. A value of 0 is reserved for "not found" and should not be stored.
+ * @param moves The number of moves played in the position.
+ * @param best_move The column of the best or cutoff move, or -1 if unknown.
  */
-void table_put(uint64_t key, uint8_t value);
+void table_put(TransTable* table, uint64_t key, uint8_t value, int moves, int best_move);
 
 /**
- * @brief Retrieves a value for a given key from the table.
+ * @brief Retrieves a value and best move for a given key from the table.
+ * Safe to call concurrently with other table_put/table_get calls on the same table.
+ * @param table Pointer to the table.
  * @param key The 64-bit position key.
+ * @param best_move If not NULL, receives the stored best move, or -1 if there is none.
  * @return The stored value, or 0 if the key is not found.
  */
-uint8_t table_get(uint64_t key);
+uint8_t table_get(const TransTable* table, uint64_t key, int* best_move);
+
+/**
+ * @brief Prefetches the bucket of a key into the cache, ahead of a table_get() or table_put().
+ * @param table Pointer to the table.
+ * @param key The 64-bit position key.
+ */
+void table_prefetch(const TransTable* table, uint64_t key);
+
+/**
+ * @brief Returns the process-wide table used by solve() and find_best_move().
+ */
+TransTable* default_table(void);
+
+/**
+ * @brief Allocates memory for the default transposition table. Must be called once at startup.
+ * @param size_mb The size of the table in megabytes, e.g. DEFAULT_TABLE_MB.
+ */
+void init_table(size_t size_mb);
+
+/**
+ * @brief Initializes the default transposition table from a snapshot file.
+ * @param filename Path of the snapshot file.
+ * @param read_only If true, map the snapshot read-only instead of copy-on-write.
+ * @return True if the snapshot was loaded, false otherwise.
+ */
+bool init_table_from_snapshot(const char* filename, bool read_only);
+
+/**
+ * @brief Clears all entries in the default transposition table.
+ */
+void reset_table(void);
+
+/**
+ * @brief Ages the entries of the default transposition table, see table_age().
+ */
+void age_table(void);
+
+/**
+ * @brief Frees the memory used by the default transposition table. Must be called once at exit.
+ */
+void free_table(void);
 
 #endif // TABLE_H
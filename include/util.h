@@ -0,0 +1,33 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdbool.h>
+
+// Helpers shared by the engine and the command-line programs.
+
+// Largest value accepted by parse_positive_int().
+#define MAX_INT_OPTION (1 << 20)
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+long long now_us(void);
+
+/**
+ * @brief Parses a whole decimal option value within a range.
+ * @param arg The option value.
+ * @param min The smallest accepted value.
+ * @param max The largest accepted value.
+ * @param value Receives the value, and is left alone if the option is invalid.
+ * @return True if arg is a number within [min, max] with nothing after it.
+ */
+bool parse_int_option(const char* arg, long long min, long long max, long long* value);
+
+/**
+ * @brief Parses a strictly positive integer option value, up to MAX_INT_OPTION.
+ * @param arg The option value.
+ * @return The value, or 0 if it is invalid.
+ */
+int parse_positive_int(const char* arg);
+
+#endif // UTIL_H
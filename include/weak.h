@@ -0,0 +1,108 @@
+#ifndef WEAK_H
+#define WEAK_H
+
+#include "bitboard.h"
+#include "book.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Outcomes returned by the weak solver, from the point of view of the player to move.
+#define WEAK_LOSS (-1)
+#define WEAK_DRAW 0
+#define WEAK_WIN 1
+
+// Outcome bounds stored in a weak table, each the result of one null-window search.
+#define WEAK_BOUND_LOSS 0     // The score is at most -1
+#define WEAK_BOUND_NOT_WIN 1  // The score is at most 0
+#define WEAK_BOUND_NOT_LOSS 2 // The score is at least 0
+#define WEAK_BOUND_WIN 3      // The score is at least 1
+
+// Smallest weak table in megabytes. Smaller tables would need more check bits than an
+// entry holds to identify keys exactly.
+#define MIN_WEAK_TABLE_MB 32
+
+// A transposition table for the weak solver. Each entry is 32 bits: a 2-bit outcome
+// bound and the hashed key bits not implied by the bucket index, so a cache line holds
+// 15 entries instead of the 8 of the exact solver's table. Each bucket records the
+// generation that filled it, which makes clearing the table a counter increment.
+typedef struct {
+    struct WeakBucket* buckets; // Cache-line-aligned buckets
+    size_t num_buckets;         // Number of buckets, a power of two
+    int index_shift;            // Right shift turning a hashed key into a bucket index
+    bool mapped;                // True if the buckets were allocated with mmap
+    uint32_t generation;        // Buckets of other generations are empty
+} WeakTable;
+
+// The state of one weak search. Contexts with their own tables can search concurrently.
+typedef struct {
+    WeakTable* table;        // Table used by this context
+    const Book* book;        // Opening book consulted for exact scores, or NULL for none
+    uint64_t nodes;          // Nodes searched by this context
+    int column_order[WIDTH]; // Column exploration order
+} WeakContext;
+
+/**
+ * @brief Allocates a weak transposition table and clears it.
+ * The size is rounded down to a power of two, and up to MIN_WEAK_TABLE_MB.
+ * @param table Pointer to the table to initialize.
+ * @param size_mb The size of the table in megabytes.
+ */
+void weak_table_init(WeakTable* table, size_t size_mb);
+
+/**
+ * @brief Clears all entries in a weak table by starting a new generation.
+ * @param table Pointer to the table.
+ */
+void weak_table_reset(WeakTable* table);
+
+/**
+ * @brief Frees the memory used by a weak table.
+ * @param table Pointer to the table.
+ */
+void weak_table_free(WeakTable* table);
+
+/**
+ * @brief Retrieves the outcome bound stored for a key.
+ * @param table Pointer to the table.
+ * @param key The key of the position.
+ * @return One of the WEAK_BOUND_* codes, or -1 if the key has no entry.
+ */
+int weak_table_get(const WeakTable* table, uint64_t key);
+
+/**
+ * @brief Stores an outcome bound for a key, replacing any earlier bound for it.
+ * @param table Pointer to the table.
+ * @param key The key of the position.
+ * @param bound One of the WEAK_BOUND_* codes.
+ */
+void weak_table_put(WeakTable* table, uint64_t key, int bound);
+
+/**
+ * @brief Prefetches the bucket of a key into the cache, ahead of a probe.
+ * @param table Pointer to the table.
+ * @param key The key of the position.
+ */
+void weak_table_prefetch(const WeakTable* table, uint64_t key);
+
+/**
+ * @brief Initializes a weak search context with the center-first move order.
+ * @param ctx Pointer to the context.
+ * @param table The weak table the context searches with.
+ * @param book The opening book consulted by the search, or NULL for none.
+ */
+void init_weak_context(WeakContext* ctx, WeakTable* table, const Book* book);
+
+/**
+ * @brief Finds whether a position is won, drawn or lost, without its exact score.
+ * The search only asks whether the score reaches a bound of 0 or 1, so it prunes far
+ * more than an exact solve. It is the exact engine's negamax compiled for outcomes,
+ * with this table instead of the exact one, and is defined in engine.c. The context's
+ * node counter is increased by the nodes searched.
+ * @param ctx Pointer to the weak search context.
+ * @param state A constant pointer to the game state to solve.
+ * @return WEAK_WIN, WEAK_DRAW or WEAK_LOSS for the player to move.
+ */
+int weak_solve_in_context(WeakContext* ctx, const GameState* state);
+
+#endif // WEAK_H
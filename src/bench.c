@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glob.h>
+#include <math.h>
+
+#include "engine.h"
+#include "bitboard.h"
+#include "table.h"
+#include "pool.h"
+#include "util.h"
+
+// Maximum accepted length of a line in a suite file.
+#define MAX_LINE_LENGTH 256
+// Maximum number of suites in one run.
+#define MAX_SUITES 64
+// Maximum length of a suite name.
+#define MAX_SUITE_NAME 64
+
+// Default throughput drop, in percent, reported as a regression by --compare.
+#define DEFAULT_TOLERANCE_PCT 10.0
+
+// The positions of one suite and their expected scores.
+typedef struct {
+    char name[MAX_SUITE_NAME]; // File name without directory or extension
+    SolveJob* jobs;
+    int* expected;             // expected[i] is the expected score of jobs[i]
+    size_t count;
+} Suite;
+
+// Results of one suite. Times are in microseconds.
+typedef struct {
+    char name[MAX_SUITE_NAME];
+    size_t positions;
+    size_t failures;
+    double total_us;
+    double mean_us;
+    double median_us;
+    double p99_us;
+    double nodes;
+    double nodes_per_pos;
+    double kn_per_s;
+} SuiteStats;
+
+// Returns the suite name of a path: its file name without the extension.
+static void suite_name(const char* path, char name[MAX_SUITE_NAME]) {
+    const char* base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    size_t length = strcspn(base, ".");
+    if (length >= MAX_SUITE_NAME) length = MAX_SUITE_NAME - 1;
+    memcpy(name, base, length);
+    name[length] = '\0';
+}
+
+// Reads up to limit positions of a suite file (0 for all). Returns false on error.
+static bool load_suite(const char* path, size_t limit, Suite* suite) {
+    suite->jobs = NULL;
+    suite->expected = NULL;
+    suite->count = 0;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open '%s'.\n", path);
+        return false;
+    }
+
+    suite_name(path, suite->name);
+    size_t capacity = 1024;
+    suite->jobs = (SolveJob*)malloc(capacity * sizeof(SolveJob));
+    suite->expected = (int*)malloc(capacity * sizeof(int));
+    if (!suite->jobs || !suite->expected) {
+        fprintf(stderr, "Error: Failed to allocate memory for the suite.\n");
+        abort();
+    }
+
+    char line[MAX_LINE_LENGTH];
+    int line_num = 0;
+    bool ok = true;
+    while ((limit == 0 || suite->count < limit) && fgets(line, sizeof(line), file)) {
+        line_num++;
+        if (line[0] == '#') continue; // Comment line.
+
+        char move_string[MAX_LINE_LENGTH];
+        int expected;
+        int fields = sscanf(line, "%255s %d", move_string, &expected);
+        if (fields < 1) continue; // Blank line.
+        char message[2 * MAX_LINE_LENGTH];
+        const char* reason = fields != 2 ? "Expected a position and its score."
+            : parse_moves(&suite->jobs[suite->count].state, move_string, message, sizeof(message));
+        if (reason) {
+            fprintf(stderr, "Error: Invalid line %d in '%s': %s\n", line_num, path, reason);
+            ok = false;
+            break;
+        }
+
+        suite->expected[suite->count++] = expected;
+        if (suite->count == capacity) {
+            capacity *= 2;
+            suite->jobs = (SolveJob*)realloc(suite->jobs, capacity * sizeof(SolveJob));
+            suite->expected = (int*)realloc(suite->expected, capacity * sizeof(int));
+            if (!suite->jobs || !suite->expected) {
+                fprintf(stderr, "Error: Failed to allocate memory for the suite.\n");
+                abort();
+            }
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+// Frees the positions of a suite.
+static void free_suite(Suite* suite) {
+    free(suite->jobs);
+    free(suite->expected);
+}
+
+// Orders suites from the easiest to the hardest: by level, then by rating.
+static int compare_suite_paths(const void* a, const void* b) {
+    int level_a = 0, rating_a = 0, level_b = 0, rating_b = 0;
+    char name_a[MAX_SUITE_NAME], name_b[MAX_SUITE_NAME];
+    suite_name(*(const char* const*)a, name_a);
+    suite_name(*(const char* const*)b, name_b);
+    sscanf(name_a, "Test_L%d_R%d", &level_a, &rating_a);
+    sscanf(name_b, "Test_L%d_R%d", &level_b, &rating_b);
+    if (level_a != level_b) return level_b - level_a;
+    if (rating_a != rating_b) return rating_a - rating_b;
+    return strcmp(name_a, name_b);
+}
+
+// Orders times in ascending order.
+static int compare_times(const void* a, const void* b) {
+    long long ta = *(const long long*)a;
+    long long tb = *(const long long*)b;
+    return (ta > tb) - (ta < tb);
+}
+
+// Returns the nearest-rank percentile of sorted values.
+static double percentile(const long long* sorted, size_t count, double fraction) {
+    size_t rank = (size_t)ceil(fraction * count);
+    return (double)sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Solves every position of a suite and computes its statistics. Mismatched scores
+// are reported on standard error but do not stop the run.
+static void run_suite(const Suite* suite, int jobs, size_t hash_mb, SolveMode mode, SuiteStats* stats) {
+    solve_jobs(suite->jobs, suite->count, jobs, hash_mb, mode, NULL, NULL);
+
+    memset(stats, 0, sizeof(*stats));
+    memcpy(stats->name, suite->name, sizeof(stats->name));
+    stats->positions = suite->count;
+    if (suite->count == 0) return;
+
+    long long* times = (long long*)malloc(suite->count * sizeof(long long));
+    if (!times) {
+        fprintf(stderr, "Error: Failed to allocate memory for the suite statistics.\n");
+        abort();
+    }
+    for (size_t i = 0; i < suite->count; i++) {
+        const SolveJob* job = &suite->jobs[i];
+        int expected = suite->expected[i];
+        if (mode != SOLVE_EXACT) {
+            expected = (expected > 0) - (expected < 0); // Only the outcome is solved.
+        }
+        if (job->score != expected) {
+            fprintf(stderr, "Error: %s position %zu expected %d, got %d.\n",
+                    suite->name, i + 1, expected, job->score);
+            stats->failures++;
+        }
+        times[i] = job->time_us;
+        stats->total_us += job->time_us;
+        stats->nodes += job->nodes;
+    }
+    qsort(times, suite->count, sizeof(long long), compare_times);
+
+    stats->mean_us = stats->total_us / suite->count;
+    stats->median_us = percentile(times, suite->count, 0.5);
+    stats->p99_us = percentile(times, suite->count, 0.99);
+    stats->nodes_per_pos = stats->nodes / suite->count;
+    stats->kn_per_s = stats->total_us > 0 ? stats->nodes / stats->total_us * 1000.0 : 0.0;
+    free(times);
+}
+
+// Prints a human-readable table of the results.
+static void print_table(FILE* out, const SuiteStats* stats, int count) {
+    fprintf(out, "%-12s %6s %5s %12s %12s %12s %12s %14s %10s\n", "suite", "pos", "fail",
+            "total ms", "mean us", "median us", "p99 us", "nodes/pos", "kn/s");
+    for (int i = 0; i < count; i++) {
+        const SuiteStats* s = &stats[i];
+        fprintf(out, "%-12s %6zu %5zu %12.1f %12.1f %12.0f %12.0f %14.1f %10.0f\n", s->name, s->positions,
+                s->failures, s->total_us / 1000.0, s->mean_us, s->median_us, s->p99_us, s->nodes_per_pos,
+                s->kn_per_s);
+    }
+}
+
+// Writes the results as CSV, one row per suite.
+static void write_csv(FILE* out, const SuiteStats* stats, int count) {
+    fprintf(out, "suite,positions,failures,total_us,mean_us,median_us,p99_us,nodes,nodes_per_pos,kn_per_s\n");
+    for (int i = 0; i < count; i++) {
+        const SuiteStats* s = &stats[i];
+        fprintf(out, "%s,%zu,%zu,%.0f,%.1f,%.0f,%.0f,%.0f,%.1f,%.1f\n", s->name, s->positions, s->failures,
+                s->total_us, s->mean_us, s->median_us, s->p99_us, s->nodes, s->nodes_per_pos, s->kn_per_s);
+    }
+}
+
+// Returns the name of a solve mode as used on the command line.
+static const char* mode_name(SolveMode mode) {
+    switch (mode) {
+    case SOLVE_WEAK: return "weak";
+    case SOLVE_DFPN: return "dfpn";
+    default: return "exact";
+    }
+}
+
+// Writes the results as JSON. Each suite is one object on its own line, which is the
+// layout read back by --compare.
+static void write_json(FILE* out, const SuiteStats* stats, int count, SolveMode mode, size_t hash_mb, int jobs) {
+    fprintf(out, "{\n  \"mode\": \"%s\",\n  \"hash_mb\": %zu,\n  \"jobs\": %d,\n  \"suites\": [\n",
+            mode_name(mode), hash_mb, jobs);
+    for (int i = 0; i < count; i++) {
+        const SuiteStats* s = &stats[i];
+        fprintf(out, "    {\"name\": \"%s\", \"positions\": %zu, \"failures\": %zu, \"total_us\": %.0f, "
+                     "\"mean_us\": %.1f, \"median_us\": %.0f, \"p99_us\": %.0f, \"nodes\": %.0f, "
+                     "\"nodes_per_pos\": %.1f, \"kn_per_s\": %.1f}%s\n",
+                s->name, s->positions, s->failures, s->total_us, s->mean_us, s->median_us, s->p99_us,
+                s->nodes, s->nodes_per_pos, s->kn_per_s, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Writes results to a file, or to standard output if the path is "-". Returns false on error.
+static bool write_report(const char* path, bool json, const SuiteStats* stats, int count, SolveMode mode,
+                         size_t hash_mb, int jobs) {
+    FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Could not create '%s'.\n", path);
+        return false;
+    }
+    if (json) {
+        write_json(out, stats, count, mode, hash_mb, jobs);
+    } else {
+        write_csv(out, stats, count);
+    }
+    bool ok = !ferror(out);
+    if (out != stdout) ok &= fclose(out) == 0;
+    if (!ok) fprintf(stderr, "Error: Failed to write '%s'.\n", path);
+    return ok;
+}
+
+// Reads a number field from one line of a JSON report. Returns false if it is missing.
+static bool json_number(const char* line, const char* key, double* value) {
+    char pattern[MAX_SUITE_NAME];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* found = strstr(line, pattern);
+    if (!found) return false;
+    char* end;
+    *value = strtod(found + strlen(pattern), &end);
+    return end != found + strlen(pattern);
+}
+
+// The settings a report was made with, which must match for results to be comparable.
+typedef struct {
+    char mode[MAX_SUITE_NAME]; // Name of the solve mode, or empty if the report has none
+    double hash_mb;            // Table size, or 0 if the report has none
+    double jobs;               // Number of jobs, or 0 if the report has none
+} BenchSettings;
+
+// Reads the suites and settings of a JSON report written by write_json(). Returns the
+// number of suites read, or -1 if the file cannot be read.
+static int read_baseline(const char* path, SuiteStats* baseline, BenchSettings* settings) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open baseline '%s'.\n", path);
+        return -1;
+    }
+    memset(settings, 0, sizeof(*settings));
+    char line[1024];
+    int count = 0;
+    while (count < MAX_SUITES && fgets(line, sizeof(line), file)) {
+        const char* mode = strstr(line, "\"mode\": \"");
+        if (mode) {
+            mode += strlen("\"mode\": \"");
+            size_t length = strcspn(mode, "\"");
+            if (length >= MAX_SUITE_NAME) length = MAX_SUITE_NAME - 1;
+            memcpy(settings->mode, mode, length);
+            settings->mode[length] = '\0';
+            continue;
+        }
+        if (json_number(line, "hash_mb", &settings->hash_mb) || json_number(line, "jobs", &settings->jobs)) {
+            continue;
+        }
+        const char* name = strstr(line, "\"name\": \"");
+        if (!name) continue;
+        SuiteStats* s = &baseline[count];
+        memset(s, 0, sizeof(*s));
+        name += strlen("\"name\": \"");
+        size_t length = strcspn(name, "\"");
+        if (length >= MAX_SUITE_NAME) length = MAX_SUITE_NAME - 1;
+        memcpy(s->name, name, length);
+
+        double positions;
+        if (!json_number(line, "positions", &positions) || !json_number(line, "nodes", &s->nodes) ||
+            !json_number(line, "nodes_per_pos", &s->nodes_per_pos) || !json_number(line, "kn_per_s", &s->kn_per_s)) {
+            fprintf(stderr, "Warning: Skipping malformed suite '%s' in the baseline.\n", s->name);
+            continue;
+        }
+        s->positions = (size_t)positions;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Compares the results with a baseline and prints one line per suite. More nodes per
+// position, or a throughput drop beyond the tolerance, is a regression. Returns the
+// number of regressions.
+static int compare_results(FILE* out, const SuiteStats* stats, int count, const SuiteStats* baseline,
+                           int baseline_count, double tolerance_pct) {
+    int regressions = 0;
+    fprintf(out, "\n%-12s %16s %16s %8s %10s %10s %8s\n", "suite", "base nodes/pos", "nodes/pos", "change",
+           "base kn/s", "kn/s", "change");
+    for (int i = 0; i < count; i++) {
+        const SuiteStats* s = &stats[i];
+        const SuiteStats* b = NULL;
+        for (int j = 0; j < baseline_count && !b; j++) {
+            if (strcmp(baseline[j].name, s->name) == 0) b = &baseline[j];
+        }
+        if (!b) {
+            fprintf(out, "%-12s not in the baseline\n", s->name);
+            continue;
+        }
+        if (b->positions != s->positions) {
+            fprintf(out, "%-12s baseline has %zu positions, this run %zu\n", s->name, b->positions, s->positions);
+            continue;
+        }
+
+        double node_change = b->nodes_per_pos > 0 ? (s->nodes_per_pos / b->nodes_per_pos - 1.0) * 100.0 : 0.0;
+        double speed_change = b->kn_per_s > 0 ? (s->kn_per_s / b->kn_per_s - 1.0) * 100.0 : 0.0;
+        // Node counts are deterministic, so any increase is a regression. Totals are
+        // compared because they are exact, unlike the rounded averages.
+        bool node_regression = s->nodes > b->nodes;
+        bool speed_regression = speed_change < -tolerance_pct;
+        fprintf(out, "%-12s %16.1f %16.1f %+7.2f%% %10.0f %10.0f %+7.1f%%%s%s\n", s->name, b->nodes_per_pos,
+               s->nodes_per_pos, node_change, b->kn_per_s, s->kn_per_s, speed_change,
+               node_regression ? "  NODES" : "", speed_regression ? "  SPEED" : "");
+        regressions += node_regression + speed_regression;
+    }
+    return regressions;
+}
+
+static void print_usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] [suite files...]\n", prog);
+    fprintf(stderr, "Solves benchmark suites in-process and reports time and node statistics per suite.\n");
+    fprintf(stderr, "Without suite files, runs every bench/tests/Test_L*_R*.txt from the easiest to the hardest.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --limit <n>         Solve only the first n positions of each suite\n");
+    fprintf(stderr, "  --hash <MB>         Size of the transposition table (default %d)\n", DEFAULT_TABLE_MB);
+    fprintf(stderr, "  --jobs <n>          Solve n positions at once, each thread with its own table (default 1)\n");
+    fprintf(stderr, "  --weak              Only solve the outcome, with the weak solver\n");
+    fprintf(stderr, "  --dfpn              Only solve the outcome, with proof-number search\n");
+    fprintf(stderr, "  --json <file>       Write the results as JSON ('-' for standard output)\n");
+    fprintf(stderr, "  --csv <file>        Write the results as CSV ('-' for standard output)\n");
+    fprintf(stderr, "  --compare <file>    Compare with a JSON baseline and fail on regressions\n");
+    fprintf(stderr, "  --tolerance <pct>   Throughput drop tolerated by --compare (default %.0f)\n",
+            DEFAULT_TOLERANCE_PCT);
+}
+
+int main(int argc, char *argv[]) {
+    const char* paths[MAX_SUITES];
+    int num_paths = 0;
+    size_t limit = 0;
+    int hash_mb = DEFAULT_TABLE_MB;
+    int jobs = 1;
+    SolveMode mode = SOLVE_EXACT;
+    const char* json_path = NULL;
+    const char* csv_path = NULL;
+    const char* baseline_path = NULL;
+    double tolerance_pct = DEFAULT_TOLERANCE_PCT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            limit = (size_t)parse_positive_int(argv[++i]);
+            if (!limit) {
+                fprintf(stderr, "Error: Invalid position limit '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            hash_mb = parse_positive_int(argv[++i]);
+            if (!hash_mb) {
+                fprintf(stderr, "Error: Invalid table size '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = parse_positive_int(argv[++i]);
+            if (!jobs) {
+                fprintf(stderr, "Error: Invalid job count '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--weak") == 0) {
+            mode = SOLVE_WEAK;
+        } else if (strcmp(argv[i], "--dfpn") == 0) {
+            mode = SOLVE_DFPN;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            char* end;
+            tolerance_pct = strtod(argv[++i], &end);
+            if (*argv[i] == '\0' || *end != '\0' || tolerance_pct < 0) {
+                fprintf(stderr, "Error: Invalid tolerance '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] != '-' && num_paths < MAX_SUITES) {
+            paths[num_paths++] = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    glob_t found = { 0 };
+    if (num_paths == 0) {
+        if (glob("bench/tests/Test_L*_R*.txt", 0, NULL, &found) != 0) {
+            fprintf(stderr, "Error: No suites found in bench/tests.\n");
+            return 1;
+        }
+        for (size_t i = 0; i < found.gl_pathc && num_paths < MAX_SUITES; i++) {
+            paths[num_paths++] = found.gl_pathv[i];
+        }
+        qsort(paths, num_paths, sizeof(const char*), compare_suite_paths);
+    }
+
+    SuiteStats baseline[MAX_SUITES];
+    int baseline_count = 0;
+    if (baseline_path) {
+        BenchSettings settings;
+        baseline_count = read_baseline(baseline_path, baseline, &settings);
+        if (baseline_count < 0) {
+            globfree(&found);
+            return 1;
+        }
+        // Node counts and throughput depend on the solver, the table size and the job count.
+        if (strcmp(settings.mode, mode_name(mode)) != 0 || settings.hash_mb != hash_mb || settings.jobs != jobs) {
+            fprintf(stderr, "Error: Baseline '%s' was run with mode '%s', --hash %.0f and --jobs %.0f, "
+                            "not mode '%s', --hash %d and --jobs %d.\n", baseline_path,
+                    settings.mode[0] ? settings.mode : "unknown", settings.hash_mb, settings.jobs,
+                    mode_name(mode), hash_mb, jobs);
+            globfree(&found);
+            return 1;
+        }
+    }
+
+    init_solver();
+    // Time the searches only, not the kernel backing each worker's new table.
+    set_table_prefault(true);
+
+    SuiteStats stats[MAX_SUITES];
+    int count = 0;
+    int status = 0;
+    for (int i = 0; i < num_paths; i++) {
+        Suite suite;
+        if (!load_suite(paths[i], limit, &suite)) {
+            free_suite(&suite);
+            status = 1;
+            continue;
+        }
+        run_suite(&suite, jobs, (size_t)hash_mb, mode, &stats[count]);
+        if (stats[count].failures) status = 1;
+        fprintf(stderr, "Info: %s: %zu positions in %.1f ms.\n", suite.name, suite.count,
+                stats[count].total_us / 1000.0);
+        count++;
+        free_suite(&suite);
+    }
+    globfree(&found);
+
+    // The table goes to standard error if a report is written to standard output.
+    bool report_on_stdout = (json_path && strcmp(json_path, "-") == 0) || (csv_path && strcmp(csv_path, "-") == 0);
+    FILE* table_out = report_on_stdout ? stderr : stdout;
+    print_table(table_out, stats, count);
+    if (json_path && !write_report(json_path, true, stats, count, mode, (size_t)hash_mb, jobs)) status = 1;
+    if (csv_path && !write_report(csv_path, false, stats, count, mode, (size_t)hash_mb, jobs)) status = 1;
+    if (baseline_path) {
+        int regressions = compare_results(table_out, stats, count, baseline, baseline_count, tolerance_pct);
+        if (regressions > 0) {
+            fprintf(stderr, "Error: %d regression%s against '%s'.\n", regressions, regressions == 1 ? "" : "s",
+                    baseline_path);
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -1,11 +1,9 @@
 #include "bitboard.h"
+#include <stdio.h>
 #include <string.h>
-
-// A mask representing the bottom row of the board.
-static const uint64_t BOTTOM_MASK = ((1ULL << (WIDTH * PHEIGHT)) - 1) / ((1ULL << PHEIGHT) - 1);
-
-// A mask representing all playable squares on the board.
-static const uint64_t BOARD_MASK = BOTTOM_MASK * ((1ULL << HEIGHT) - 1);
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 // Returns a mask for the top-most cell of a column.
 static uint64_t top_mask_for_col(int col) {
@@ -33,34 +31,7 @@ static unsigned int popcount(uint64_t m) {
 
 // Computes a bitmask of all positions where the given player can win on the next move.
 static uint64_t compute_winning_position(uint64_t position, uint64_t mask) {
-    // Vertical check
-    uint64_t r = (position << 1) & (position << 2) & (position << 3);
-    
-    // Horizontal check
-    uint64_t p = (position << PHEIGHT) & (position << (2 * PHEIGHT));
-    r |= p & (position << (3 * PHEIGHT));
-    r |= p & (position >> PHEIGHT);
-    p = (position >> PHEIGHT) & (position >> (2 * PHEIGHT));
-    r |= p & (position << PHEIGHT);
-    r |= p & (position >> (3 * PHEIGHT));
-    
-    // Diagonal (y = -x) check
-    p = (position << (PHEIGHT - 1)) & (position << (2 * (PHEIGHT - 1)));
-    r |= p & (position << (3 * (PHEIGHT - 1)));
-    r |= p & (position >> (PHEIGHT - 1));
-    p = (position >> (PHEIGHT - 1)) & (position >> (2 * (PHEIGHT - 1)));
-    r |= p & (position << (PHEIGHT - 1));
-    r |= p & (position >> (3 * (PHEIGHT - 1)));
-    
-    // Diagonal (y = x) check
-    p = (position << (PHEIGHT + 1)) & (position << (2 * (PHEIGHT + 1)));
-    r |= p & (position << (3 * (PHEIGHT + 1)));
-    r |= p & (position >> (PHEIGHT + 1));
-    p = (position >> (PHEIGHT + 1)) & (position >> (2 * (PHEIGHT + 1)));
-    r |= p & (position << (PHEIGHT + 1));
-    r |= p & (position >> (3 * (PHEIGHT + 1)));
-    
-    return r & (BOARD_MASK ^ mask); // Exclude spots that are already occupied.
+    return threat_cells(position) & (BOARD_MASK ^ mask); // Exclude spots that are already occupied.
 }
 
 // Computes the winning positions for the opponent.
@@ -108,6 +79,98 @@ void play_move(GameState* state, int col) {
     state->moves++;
 }
 
+// Initializes a search state and the threat masks of both players.
+void init_search_state(SearchState* search, const GameState* state) {
+    assert(search != NULL && state != NULL);
+    search->pos = *state;
+    search->threats = threat_cells(state->current_position);
+    search->opponent_threats = threat_cells(state->current_position ^ state->mask);
+}
+
+#ifdef __AVX2__
+// Number of 64-bit lanes in a vector.
+#define LANES 4
+
+// Shifts all lanes left or right by a constant number of bits.
+#define SHL(v, n) _mm256_slli_epi64((v), (n))
+#define SHR(v, n) _mm256_srli_epi64((v), (n))
+
+// Vector version of threat_cells(), computing four positions at once.
+__attribute__((always_inline))
+static inline __m256i threat_cells_x4(__m256i position) {
+    __m256i r = _mm256_and_si256(_mm256_and_si256(SHL(position, 1), SHL(position, 2)), SHL(position, 3));
+
+    // Horizontal, then both diagonals, with the same pattern as threat_cells().
+    #define LINE_THREATS(d) do { \
+        __m256i p = _mm256_and_si256(SHL(position, (d)), SHL(position, 2 * (d))); \
+        r = _mm256_or_si256(r, _mm256_and_si256(p, SHL(position, 3 * (d)))); \
+        r = _mm256_or_si256(r, _mm256_and_si256(p, SHR(position, (d)))); \
+        p = _mm256_and_si256(SHR(position, (d)), SHR(position, 2 * (d))); \
+        r = _mm256_or_si256(r, _mm256_and_si256(p, SHL(position, (d)))); \
+        r = _mm256_or_si256(r, _mm256_and_si256(p, SHR(position, 3 * (d)))); \
+    } while (0)
+    LINE_THREATS(PHEIGHT);
+    LINE_THREATS(PHEIGHT - 1);
+    LINE_THREATS(PHEIGHT + 1);
+    #undef LINE_THREATS
+
+    return r;
+}
+
+// Counts the set bits of each lane, looking up the count of every nibble.
+__attribute__((always_inline))
+static inline __m256i popcount_x4(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low_nibbles));
+    __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+    return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+}
+
+// Scores candidate moves four at a time. The unused lanes of the last vector hold no move.
+void score_moves_batch(const SearchState* search, const uint64_t moves[WIDTH], int count,
+                       uint64_t threats[WIDTH], int scores[WIDTH]) {
+    assert(search != NULL && count >= 0 && count <= WIDTH);
+    const __m256i position = _mm256_set1_epi64x((long long)search->pos.current_position);
+    const __m256i empty = _mm256_set1_epi64x((long long)(BOARD_MASK ^ search->pos.mask));
+
+    for (int i = 0; i < count; i += LANES) {
+        uint64_t lane_moves[LANES] = {0};
+        uint64_t lane_threats[LANES];
+        uint64_t lane_scores[LANES];
+        for (int j = 0; j < LANES && i + j < count; j++) {
+            lane_moves[j] = moves[i + j];
+        }
+
+        __m256i move = _mm256_loadu_si256((const __m256i*)lane_moves);
+        __m256i t = threat_cells_x4(_mm256_or_si256(position, move));
+        __m256i n = popcount_x4(_mm256_andnot_si256(move, _mm256_and_si256(t, empty)));
+        _mm256_storeu_si256((__m256i*)lane_threats, t);
+        _mm256_storeu_si256((__m256i*)lane_scores, n);
+
+        for (int j = 0; j < LANES && i + j < count; j++) {
+            threats[i + j] = lane_threats[j];
+            scores[i + j] = (int)lane_scores[j];
+        }
+    }
+}
+
+#undef SHL
+#undef SHR
+#undef LANES
+#else
+// Scores candidate moves one at a time.
+void score_moves_batch(const SearchState* search, const uint64_t moves[WIDTH], int count,
+                       uint64_t threats[WIDTH], int scores[WIDTH]) {
+    assert(search != NULL && count >= 0 && count <= WIDTH);
+    for (int i = 0; i < count; i++) {
+        threats[i] = threats_after_move(search, moves[i]);
+        scores[i] = search_state_move_score(search, moves[i], threats[i]);
+    }
+}
+#endif
+
 // Checks if a move can be legally played in a given column.
 bool can_play(const GameState* state, int col) {
     assert(state != NULL);
@@ -184,6 +247,29 @@ int bitboard_to_col(uint64_t move) {
     return count_trailing_zeros(move) / PHEIGHT;
 }
 
+// Plays a move string on an empty board, writing the reason to message if it is rejected.
+const char* parse_moves(GameState* state, const char* moves, char* message, size_t size) {
+    assert(state != NULL && moves != NULL && message != NULL);
+    init_gamestate(state);
+    for (const char* c = moves; *c; c++) {
+        int col = *c - '1'; // Moves are 1-indexed in the string.
+        if (col < 0 || col >= WIDTH) {
+            snprintf(message, size, "Invalid column '%c' in position '%s'.", *c, moves);
+            return message;
+        }
+        if (!can_play(state, col)) {
+            snprintf(message, size, "Column %d is full in position '%s'.", col + 1, moves);
+            return message;
+        }
+        if (is_winning_move(state, col)) {
+            snprintf(message, size, "Position '%s' contains a winning move.", moves);
+            return message;
+        }
+        play_move(state, col);
+    }
+    return NULL;
+}
+
 // Returns a bitmask of all possible moves.
 uint64_t possible(const GameState* state) {
     return (state->mask + BOTTOM_MASK) & BOARD_MASK;
@@ -1,119 +1,421 @@
 #include "book.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-// Represents a single entry in the opening book, mapping a board state to a move.
-// The struct is packed to minimize memory usage when loading the book file.
+// Book files start with this magic string and format version.
+#define BOOK_MAGIC "C4BOOK\0\0"
+#define BOOK_VERSION 3
+// Oldest version that can still be loaded. Version 2 books hold no scores.
+#define BOOK_MIN_VERSION 2
+
+// Header flag set if the book stores the score of every move.
+#define BOOK_FLAG_CHILD_SCORES 1u
+
+// Layout of a packed 64-bit book entry, from the least significant bit:
+//   [0, 3)   best move (0-indexed column)
+//   [3, 9)   exact score of the position, encoded as below
+//   [9, 15)  reserved, zero
+//   [15, 64) canonical position key
+// Entries compare in key order, so they can be searched as plain integers.
+#define ENTRY_MOVE_MASK 0x7ULL
+#define ENTRY_SCORE_SHIFT 3
+#define ENTRY_KEY_SHIFT 15
+
+// Scores are stored in 6-bit fields as score - MIN_SCORE + 1, with 0 meaning unknown.
+// Books with child scores hold a second array parallel to the entries, with the
+// score of playing column c in bits [6c, 6c + 6) of each word.
+#define SCORE_BITS 6
+#define SCORE_MASK ((1ULL << SCORE_BITS) - 1)
+
+// The 64-byte header at the start of a book file. The entries follow it in
+// Eytzinger order: slot 0 is padding and slots 1..size hold the entries. With
+// BOOK_FLAG_CHILD_SCORES, the child scores follow in the same order.
 typedef struct {
-    uint128_t key;
+    char magic[8];       // BOOK_MAGIC
+    uint32_t version;    // BOOK_VERSION
+    uint32_t width;      // Board width the book was built for
+    uint32_t height;     // Board height the book was built for
+    uint32_t depth;      // The book covers positions with fewer moves than this
+    uint64_t size;       // Number of entries
+    uint32_t flags;      // BOOK_FLAG_* bits
+    uint8_t reserved[28];
+} BookHeader;
+
+// Represents a single entry in the older book format, mapping a board state to a move.
+// The struct is packed to match the file layout.
+typedef struct LegacyBookEntry {
+    __uint128_t key; // mask << 64 | current_position
     uint8_t move;
-} __attribute__((packed)) BookEntry;
+} __attribute__((packed)) LegacyBookEntry;
 
-static BookEntry* g_book_entries = NULL;
-static size_t g_book_size = 0;
+_Static_assert(sizeof(BookHeader) == 64, "book header must be 64 bytes");
+_Static_assert(WIDTH * PHEIGHT + ENTRY_KEY_SHIFT <= 64, "position keys must fit in a book entry");
+_Static_assert(WIDTH <= 8, "moves must fit in three bits");
+_Static_assert(MAX_SCORE - MIN_SCORE + 1 <= (int)SCORE_MASK, "scores must fit in six bits");
+_Static_assert(WIDTH * SCORE_BITS <= 64, "child scores must fit in one word");
 
-// Loads the opening book from "book.bin" into memory.
-void init_book(void) {
-    const char* book_filename = "book.bin";
-    FILE* file = fopen(book_filename, "rb");
-    if (!file) {
-        fprintf(stderr, "Info: Opening book '%s' not found. Continuing without it.\n", book_filename);
-        return;
+// The book used by find_best_move() and solve().
+static Book g_book = { NULL, NULL, 0, 0, NULL, 0 };
+
+// Encodes a score, or BOOK_NO_SCORE, into a 6-bit field.
+static uint64_t encode_score(int score) {
+    return score == BOOK_NO_SCORE ? 0 : (uint64_t)(score - MIN_SCORE + 1);
+}
+
+// Decodes a 6-bit score field.
+static int decode_score(uint64_t value) {
+    return value == 0 ? BOOK_NO_SCORE : (int)value + MIN_SCORE - 1;
+}
+
+// Packs a key, move and score into a book entry.
+static uint64_t pack_entry(uint64_t key, int move, int score) {
+    return key << ENTRY_KEY_SHIFT | encode_score(score) << ENTRY_SCORE_SHIFT | (uint64_t)move;
+}
+
+// Packs the scores of every move of a record.
+static uint64_t pack_child_scores(const BookRecord* record) {
+    uint64_t packed = 0;
+    for (int col = 0; col < WIDTH; col++) {
+        packed |= encode_score(record->child_scores[col]) << (col * SCORE_BITS);
     }
+    return packed;
+}
+
+// Orders book records by key.
+static int compare_records(const void* a, const void* b) {
+    uint64_t ka = ((const BookRecord*)a)->key;
+    uint64_t kb = ((const BookRecord*)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+// Packs sorted records into out[k] and its subtree, starting at records[i].
+// Returns the index of the first record not yet placed.
+static size_t eytzinger_fill(const BookRecord* sorted, uint64_t* entries, uint64_t* child_scores,
+                             size_t size, size_t i, size_t k) {
+    if (k <= size) {
+        i = eytzinger_fill(sorted, entries, child_scores, size, i, 2 * k);
+        entries[k] = pack_entry(sorted[i].key, sorted[i].move, sorted[i].score);
+        if (child_scores) child_scores[k] = pack_child_scores(&sorted[i]);
+        i++;
+        i = eytzinger_fill(sorted, entries, child_scores, size, i, 2 * k + 1);
+    }
+    return i;
+}
 
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+// Sorts and deduplicates records and returns their packed entries in Eytzinger
+// order in a new array of *size + 1 slots, followed by as many slots of child
+// scores if requested. Aborts if memory runs out.
+static uint64_t* build_entries(BookRecord* records, size_t count, bool with_child_scores, size_t* size) {
+    qsort(records, count, sizeof(BookRecord), compare_records);
 
-    if (file_size == 0) {
-        fclose(file);
-        return;
+    size_t unique = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (unique > 0 && records[i].key == records[unique - 1].key) continue;
+        records[unique++] = records[i];
     }
-    
-    // The file size must be a multiple of the entry size.
-    assert(file_size % sizeof(BookEntry) == 0);
 
-    g_book_size = file_size / sizeof(BookEntry);
-    g_book_entries = (BookEntry*)malloc(file_size);
-    if (!g_book_entries) {
+    size_t slots = unique + 1;
+    uint64_t* entries = (uint64_t*)calloc(with_child_scores ? 2 * slots : slots, sizeof(uint64_t));
+    if (!entries) {
         fprintf(stderr, "Error: Failed to allocate memory for the opening book.\n");
-        fclose(file);
-        g_book_size = 0;
-        return;
-    }
-
-    size_t items_read = fread(g_book_entries, sizeof(BookEntry), g_book_size, file);
-    if (items_read != g_book_size) {
-        fprintf(stderr, "Error: Failed to read the opening book file correctly.\n");
-        free(g_book_entries);
-        g_book_entries = NULL;
-        g_book_size = 0;
-    } else {
-        #ifdef DEBUG
-        fprintf(stderr, "DEBUG: Opening book loaded successfully with %zu entries.\n", g_book_size);
-        fprintf(stderr, "DEBUG: ---- Verifying first 10 book entries ----\n");
-        size_t limit = g_book_size < 10 ? g_book_size : 10;
-        for (size_t i = 0; i < limit; ++i) {
-            uint128_t key = g_book_entries[i].key;
-            uint64_t key_high = (uint64_t)(key >> 64);
-            uint64_t key_low = (uint64_t)key;
-            fprintf(stderr, "DEBUG: Entry %zu -> Key (Mask/Pos): %-10llu / %-10llu | Move: %u\n", 
-                   i, key_high, key_low, g_book_entries[i].move);
+        abort();
+    }
+    eytzinger_fill(records, entries, with_child_scores ? entries + slots : NULL, unique, 0, 1);
+
+    *size = unique;
+    return entries;
+}
+
+// Converts a book in the older format of sorted 17-byte records.
+static bool load_legacy_book(Book* book, const void* data, size_t file_size) {
+    if (file_size % sizeof(LegacyBookEntry) != 0) {
+        return false;
+    }
+
+    size_t count = file_size / sizeof(LegacyBookEntry);
+    BookRecord* records = (BookRecord*)malloc((count + 1) * sizeof(BookRecord));
+    if (!records) {
+        fprintf(stderr, "Error: Failed to allocate memory for the opening book.\n");
+        abort();
+    }
+
+    const LegacyBookEntry* legacy = (const LegacyBookEntry*)data;
+    for (size_t i = 0; i < count; ++i) {
+        GameState state = {
+            .current_position = (uint64_t)legacy[i].key,
+            .mask = (uint64_t)(legacy[i].key >> 64),
+        };
+        bool mirrored;
+        records[i].key = book_canonical_key(&state, &mirrored);
+        records[i].move = mirrored ? WIDTH - 1 - legacy[i].move : legacy[i].move;
+        records[i].score = BOOK_NO_SCORE;
+    }
+
+    size_t size;
+    uint64_t* entries = build_entries(records, count, false, &size);
+    free(records);
+
+    book->entries = entries;
+    book->child_scores = NULL;
+    book->size = size;
+    book->depth = MAX_BOOK_DEPTH;
+    book->storage = entries;
+    book->mapped_bytes = 0;
+    return true;
+}
+
+// Maps a book file into memory, converting it if it uses the older format.
+bool book_load(Book* book, const char* book_filename) {
+    assert(book != NULL);
+    *book = (Book){ NULL, NULL, 0, 0, NULL, 0 };
+
+    int fd = open(book_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Info: Opening book '%s' not found. Continuing without it.\n", book_filename);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    void* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: Failed to map the opening book '%s'.\n", book_filename);
+        return false;
+    }
+
+    const BookHeader* header = (const BookHeader*)data;
+    if (file_size < sizeof(BookHeader) || memcmp(header->magic, BOOK_MAGIC, sizeof(header->magic)) != 0) {
+        bool loaded = load_legacy_book(book, data, file_size);
+        munmap(data, file_size);
+        if (!loaded) {
+            fprintf(stderr, "Warning: '%s' is not an opening book. Continuing without it.\n", book_filename);
         }
-        fprintf(stderr, "DEBUG: ----------------------------------------\n");
-        #endif
+        return loaded;
+    }
+
+    // The depth and size are checked against the board and the file before any
+    // arithmetic, so that a corrupt header cannot wrap the expected file size around.
+    bool has_child_scores = header->version >= 3 && (header->flags & BOOK_FLAG_CHILD_SCORES);
+    size_t max_size = (file_size - sizeof(BookHeader)) / sizeof(uint64_t);
+    if (header->version < BOOK_MIN_VERSION || header->version > BOOK_VERSION ||
+        header->width != WIDTH || header->height != HEIGHT ||
+        header->depth > WIDTH * HEIGHT || header->size > max_size ||
+        file_size != sizeof(BookHeader) + (has_child_scores ? 2 : 1) * ((size_t)header->size + 1) * sizeof(uint64_t)) {
+        fprintf(stderr, "Warning: Opening book '%s' does not match this solver. Continuing without it.\n",
+                book_filename);
+        munmap(data, file_size);
+        return false;
+    }
+    madvise(data, file_size, MADV_WILLNEED);
+
+    book->entries = (const uint64_t*)((const char*)data + sizeof(BookHeader));
+    book->child_scores = has_child_scores ? book->entries + header->size + 1 : NULL;
+    book->size = (size_t)header->size;
+    book->depth = (int)header->depth;
+    book->storage = data;
+    book->mapped_bytes = file_size;
+
+    #ifdef DEBUG
+    fprintf(stderr, "DEBUG: Opening book loaded successfully with %zu entries.\n", book->size);
+    fprintf(stderr, "DEBUG: ---- Verifying first 10 book entries ----\n");
+    size_t limit = book->size < 10 ? book->size : 10;
+    for (size_t i = 1; i <= limit; ++i) {
+        fprintf(stderr, "DEBUG: Entry %zu -> Key: %-16llu | Move: %u\n", i,
+                (unsigned long long)(book->entries[i] >> ENTRY_KEY_SHIFT),
+                (unsigned)(book->entries[i] & ENTRY_MOVE_MASK));
     }
+    fprintf(stderr, "DEBUG: ----------------------------------------\n");
+    #endif
 
-    fclose(file);
+    return true;
+}
+
+// Unmaps or frees the memory of a book.
+void book_free(Book* book) {
+    assert(book != NULL);
+    if (book->storage) {
+        if (book->mapped_bytes) {
+            munmap(book->storage, book->mapped_bytes);
+        } else {
+            free(book->storage);
+        }
+    }
+    *book = (Book){ NULL, NULL, 0, 0, NULL, 0 };
 }
 
-// Frees the memory allocated for the opening book.
+// Writes records to a book file, header first, then the entries in Eytzinger order.
+bool book_write(const char* filename, BookRecord* records, size_t count, int depth, bool with_child_scores) {
+    assert(records != NULL || count == 0);
+
+    size_t size;
+    uint64_t* entries = build_entries(records, count, with_child_scores, &size);
+    size_t slots = (with_child_scores ? 2 : 1) * (size + 1);
+
+    BookHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BOOK_MAGIC, sizeof(header.magic));
+    header.version = BOOK_VERSION;
+    header.width = WIDTH;
+    header.height = HEIGHT;
+    header.depth = (uint32_t)depth;
+    header.size = size;
+    header.flags = with_child_scores ? BOOK_FLAG_CHILD_SCORES : 0;
+
+    // Write to a temporary file and rename it over the target, so that processes
+    // still mapping an older book keep reading intact data.
+    char temp_filename[4096];
+    if (snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename) >= (int)sizeof(temp_filename)) {
+        fprintf(stderr, "Error: Book path '%s' is too long.\n", filename);
+        free(entries);
+        return false;
+    }
+    FILE* file = fopen(temp_filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not create opening book '%s'.\n", temp_filename);
+        free(entries);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(entries, sizeof(uint64_t), slots, file) == slots;
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(temp_filename, filename) == 0;
+    free(entries);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write opening book '%s'.\n", filename);
+        remove(temp_filename);
+    }
+    return ok;
+}
+
+// Returns the process-wide default book.
+const Book* default_book(void) {
+    return &g_book;
+}
+
+// Loads the default opening book from "book.bin".
+void init_book(void) {
+    book_free(&g_book); // Allow repeated initialization without leaking the previous book.
+    book_load(&g_book, "book.bin");
+}
+
+// Frees the memory of the default opening book.
 void free_book(void) {
-    if (g_book_entries) {
-        free(g_book_entries);
-        g_book_entries = NULL;
-        g_book_size = 0;
+    book_free(&g_book);
+}
+
+// Computes the key of whichever orientation of the position has the smaller key.
+uint64_t book_canonical_key(const GameState* state, bool* mirrored) {
+    uint64_t key = get_key(state);
+    uint64_t mirror_key = mirror_bitboard(key);
+    *mirrored = mirror_key < key;
+    return *mirrored ? mirror_key : key;
+}
+
+// Returns the slot of the entry holding a canonical key, or 0 if the book has none.
+static size_t find_entry(const Book* book, uint64_t key) {
+    if (book->size == 0) {
+        return 0;
+    }
+
+    // Branchless descent of the implicit tree: the children of slot k are 2k and
+    // 2k+1, so the eight slots three levels below k share one cache line that can be
+    // fetched while the current level is compared.
+    const uint64_t* entries = book->entries;
+    const uint64_t target = key << ENTRY_KEY_SHIFT;
+    size_t k = 1;
+    while (k <= book->size) {
+        __builtin_prefetch(&entries[8 * k]);
+        k = 2 * k + (entries[k] < target);
+    }
+    // Undo the trailing right turns to reach the first entry not below the target.
+    k >>= __builtin_ffsll((long long)~k);
+
+    if (k == 0 || entries[k] >> ENTRY_KEY_SHIFT != key) {
+        #ifdef DEBUG
+        fprintf(stderr, "DEBUG: Book miss.\n");
+        #endif
+        return 0;
     }
+    return k;
 }
 
-// Computes a unique 128-bit key from the current game state's bitboards.
-uint128_t book_compute_key(const GameState* state) {
-    return ((uint128_t)state->mask << 64) | state->current_position;
+// Searches a book for a position's move, mapping it back from the canonical orientation.
+bool book_lookup_position(const Book* book, const GameState* state, int* move) {
+    bool mirrored;
+    uint64_t key = book_canonical_key(state, &mirrored);
+    if (!book_lookup(book, key, move)) {
+        return false;
+    }
+    if (mirrored) {
+        *move = WIDTH - 1 - *move;
+    }
+    return true;
 }
 
-// Searches the opening book for a move corresponding to the given key.
-bool book_get_move(uint128_t key, int* move) {
-    assert(move != NULL);
+// Searches a book for the exact score of a position.
+bool book_lookup_score(const Book* book, const GameState* state, int* score) {
+    assert(book != NULL);
+    bool mirrored;
+    size_t k = find_entry(book, book_canonical_key(state, &mirrored));
+    if (k == 0) {
+        return false;
+    }
+    int value = decode_score(book->entries[k] >> ENTRY_SCORE_SHIFT & SCORE_MASK);
+    if (value == BOOK_NO_SCORE) {
+        return false;
+    }
+    *score = value;
+    return true;
+}
 
-    if (!g_book_entries || g_book_size == 0) {
+// Searches a book for the scores of every move of a position, in its own orientation.
+bool book_lookup_move_scores(const Book* book, const GameState* state, int scores[WIDTH]) {
+    assert(book != NULL);
+    if (!book->child_scores) {
+        return false;
+    }
+    bool mirrored;
+    size_t k = find_entry(book, book_canonical_key(state, &mirrored));
+    if (k == 0) {
         return false;
     }
-    
-    // Binary search for the key in the sorted book entries.
-    int low = 0;
-    int high = g_book_size - 1;
+    for (int col = 0; col < WIDTH; col++) {
+        int canonical_col = mirrored ? WIDTH - 1 - col : col;
+        scores[col] = decode_score(book->child_scores[k] >> (canonical_col * SCORE_BITS) & SCORE_MASK);
+    }
+    return true;
+}
 
-    while (low <= high) {
-        int mid = low + (high - low) / 2;
-        uint128_t mid_key = g_book_entries[mid].key;
+// Searches a book for a move corresponding to the given key.
+bool book_lookup(const Book* book, uint64_t key, int* move) {
+    assert(book != NULL);
+    assert(move != NULL);
 
-        if (mid_key < key) {
-            low = mid + 1;
-        } else if (mid_key > key) {
-            high = mid - 1;
-        } else {
-            *move = g_book_entries[mid].move;
-            #ifdef DEBUG
-            fprintf(stderr, "DEBUG: Book hit! Found move: %d\n", *move);
-            #endif
-            return true;
-        }
+    size_t k = find_entry(book, key);
+    if (k == 0) {
+        return false;
     }
-    
+
+    *move = (int)(book->entries[k] & ENTRY_MOVE_MASK);
     #ifdef DEBUG
-    fprintf(stderr, "DEBUG: Book miss.\n");
+    fprintf(stderr, "DEBUG: Book hit! Found move: %d\n", *move);
     #endif
+    return true;
+}
 
-    return false;
-}
\ No newline at end of file
+// Searches the default opening book for a move corresponding to the given key.
+bool book_get_move(uint64_t key, int* move) {
+    return book_lookup(&g_book, key, move);
+}
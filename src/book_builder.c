@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "engine.h"
+#include "bitboard.h"
+#include "table.h"
+#include "book.h"
+#include "util.h"
+
+// Deepest book the builder accepts. Deeper books hold too many positions to enumerate in memory.
+#define MAX_BUILD_DEPTH 16
+
+// Maximum number of solver threads.
+#define MAX_BUILD_THREADS 256
+
+// One ply of canonical positions, solved in parallel by the worker threads.
+typedef struct {
+    const GameState* positions; // Sorted by key
+    BookRecord* records;        // records[i] receives the best move and scores of positions[i]
+    size_t count;
+    size_t next;                // Index of the next position to hand out, taken atomically
+    const GameState* children;  // The next ply, already solved, or NULL for the deepest ply
+    const BookRecord* child_records;
+    size_t child_count;
+    bool child_scores;          // Score every move, even when a winning move makes it unnecessary
+    TransTable* table;          // Shared by all workers, so each search warms the table for the others
+} BuildLevel;
+
+// A worker thread and its search statistics.
+typedef struct {
+    pthread_t thread;
+    BuildLevel* level;
+    uint64_t nodes;
+} BuildWorker;
+
+// Returns the orientation of a position that has the smaller key.
+static GameState canonical_state(const GameState* state) {
+    GameState mirrored = {
+        .current_position = mirror_bitboard(state->current_position),
+        .mask = mirror_bitboard(state->mask),
+        .moves = state->moves,
+    };
+    return get_key(&mirrored) < get_key(state) ? mirrored : *state;
+}
+
+// Orders positions by key.
+static int compare_states(const void* a, const void* b) {
+    uint64_t ka = get_key((const GameState*)a);
+    uint64_t kb = get_key((const GameState*)b);
+    return (ka > kb) - (ka < kb);
+}
+
+// Returns the canonical positions one ply after the given ones, without duplicates.
+// Moves that win are not followed, since the game ends there.
+static GameState* next_level(const GameState* level, size_t count, size_t* next_count) {
+    GameState* next = (GameState*)malloc((count * WIDTH + 1) * sizeof(GameState));
+    if (!next) {
+        fprintf(stderr, "Error: Failed to allocate memory for the book positions.\n");
+        abort();
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (int col = 0; col < WIDTH; col++) {
+            if (!can_play(&level[i], col) || is_winning_move(&level[i], col)) continue;
+            GameState child = level[i];
+            play_move(&child, col);
+            next[n++] = canonical_state(&child);
+        }
+    }
+
+    qsort(next, n, sizeof(GameState), compare_states);
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (unique > 0 && get_key(&next[i]) == get_key(&next[unique - 1])) continue;
+        next[unique++] = next[i];
+    }
+
+    *next_count = unique;
+    return next;
+}
+
+// Returns the score of a child position, from the next ply if it has been solved
+// already and otherwise by searching it.
+static int child_score(SearchContext* ctx, const BuildLevel* level, const GameState* child) {
+    if (!level->children) {
+        return solve_in_context(ctx, child, false);
+    }
+
+    GameState canonical = canonical_state(child);
+    const GameState* found = (const GameState*)bsearch(&canonical, level->children, level->child_count,
+                                                       sizeof(GameState), compare_states);
+    assert(found != NULL); // Every child that does not end the game is in the next ply.
+    return level->child_records[found - level->children].score;
+}
+
+// Scores the moves of a position and fills its record with the best move, the
+// position's exact score and the score of every move that was searched.
+static void solve_position(SearchContext* ctx, const BuildLevel* level, const GameState* state,
+                           BookRecord* record) {
+    record->key = get_key(state);
+    record->move = -1;
+    record->score = BOOK_NO_SCORE;
+    for (int col = 0; col < WIDTH; col++) {
+        record->child_scores[col] = BOOK_NO_SCORE;
+    }
+
+    for (int i = 0; i < WIDTH; i++) {
+        int col = ctx->column_order[i];
+        if (!can_play(state, col)) continue;
+
+        int move_score;
+        bool winning = is_winning_move(state, col);
+        if (winning) {
+            move_score = (WIDTH * HEIGHT + 1 - state->moves) / 2;
+        } else {
+            GameState child = *state;
+            play_move(&child, col);
+            move_score = -child_score(ctx, level, &child);
+        }
+        record->child_scores[col] = move_score;
+        if (record->move < 0 || move_score > record->score) {
+            record->move = col;
+            record->score = move_score;
+        }
+        // No move beats an immediate win.
+        if (winning && !level->child_scores) break;
+    }
+}
+
+// Worker loop: solves the positions of the level until none are left.
+static void* build_worker_main(void* arg) {
+    BuildWorker* worker = (BuildWorker*)arg;
+    BuildLevel* level = worker->level;
+
+    SearchContext ctx;
+    init_search_context(&ctx, level->table, NULL);
+
+    size_t i;
+    while ((i = __atomic_fetch_add(&level->next, 1, __ATOMIC_RELAXED)) < level->count) {
+        solve_position(&ctx, level, &level->positions[i], &level->records[i]);
+    }
+
+    worker->nodes = ctx.nodes;
+    return NULL;
+}
+
+// Solves one level on the given number of threads and returns the nodes searched.
+static uint64_t solve_level(BuildLevel* level, int threads) {
+    BuildWorker workers[MAX_BUILD_THREADS];
+    int started = 0;
+    for (; started < threads; started++) {
+        workers[started] = (BuildWorker){ .level = level, .nodes = 0 };
+        if (pthread_create(&workers[started].thread, NULL, build_worker_main, &workers[started]) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        // No thread could be started, so solve everything on the calling thread.
+        workers[0] = (BuildWorker){ .level = level, .nodes = 0 };
+        build_worker_main(&workers[0]);
+        return workers[0].nodes;
+    }
+
+    uint64_t nodes = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        nodes += workers[i].nodes;
+    }
+    return nodes;
+}
+
+// Prints the command-line usage.
+static void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s [options]\n", prog_name);
+    fprintf(stderr, "Builds an opening book with the best move and exact score of every position up to a given depth.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --depth <n>     Cover positions with fewer than n moves (default %d, at most %d)\n",
+            MAX_BOOK_DEPTH, MAX_BUILD_DEPTH);
+    fprintf(stderr, "  --threads <n>   Number of solver threads sharing the table (default: all cores)\n");
+    fprintf(stderr, "  --hash <MB>     Size of the shared transposition table (default %d)\n", DEFAULT_TABLE_MB);
+    fprintf(stderr, "  --output <file> Book file to write (default book.bin)\n");
+    fprintf(stderr, "  --child-scores  Also store the exact score of every move\n");
+}
+
+int main(int argc, char *argv[]) {
+    int depth = MAX_BOOK_DEPTH;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cores < 1 ? 1 : cores > MAX_BUILD_THREADS ? MAX_BUILD_THREADS : (int)cores;
+    int hash_mb = DEFAULT_TABLE_MB;
+    const char* output = "book.bin";
+    bool child_scores = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = parse_positive_int(argv[++i]);
+            if (!depth || depth > MAX_BUILD_DEPTH) {
+                fprintf(stderr, "Error: Invalid book depth '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = parse_positive_int(argv[++i]);
+            if (!threads || threads > MAX_BUILD_THREADS) {
+                fprintf(stderr, "Error: Invalid thread count '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            hash_mb = parse_positive_int(argv[++i]);
+            if (!hash_mb) {
+                fprintf(stderr, "Error: Invalid table size '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--child-scores") == 0) {
+            child_scores = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Enumerate the canonical positions of every ply covered by the book.
+    GameState* levels[MAX_BUILD_DEPTH];
+    size_t counts[MAX_BUILD_DEPTH];
+    size_t total = 1;
+    levels[0] = (GameState*)malloc(sizeof(GameState));
+    if (!levels[0]) {
+        fprintf(stderr, "Error: Failed to allocate memory for the book positions.\n");
+        abort();
+    }
+    init_gamestate(&levels[0][0]);
+    counts[0] = 1;
+    for (int ply = 1; ply < depth; ply++) {
+        levels[ply] = next_level(levels[ply - 1], counts[ply - 1], &counts[ply]);
+        total += counts[ply];
+    }
+    printf("Building a depth %d book of %zu positions with %d threads and a %d MB table.\n",
+           depth, total, threads, hash_mb);
+    fflush(stdout);
+
+    BookRecord* records = (BookRecord*)malloc(total * sizeof(BookRecord));
+    if (!records) {
+        fprintf(stderr, "Error: Failed to allocate memory for the book entries.\n");
+        abort();
+    }
+
+    TransTable table;
+    table_init(&table, (size_t)hash_mb);
+    table_set_reset_threads(&table, threads);
+
+    // Only the deepest ply needs searching. Every shallower position is scored from the
+    // exact scores of its children, which are solved one ply earlier.
+    size_t offset = total;
+    uint64_t total_nodes = 0;
+    long long build_start = now_us();
+    for (int ply = depth - 1; ply >= 0; ply--) {
+        size_t child_offset = offset;
+        offset -= counts[ply];
+        bool deepest = ply == depth - 1;
+        BuildLevel level = {
+            .positions = levels[ply],
+            .records = records + offset,
+            .count = counts[ply],
+            .next = 0,
+            .children = deepest ? NULL : levels[ply + 1],
+            .child_records = deepest ? NULL : records + child_offset,
+            .child_count = deepest ? 0 : counts[ply + 1],
+            .child_scores = child_scores,
+            .table = &table,
+        };
+        long long start = now_us();
+        uint64_t nodes = solve_level(&level, threads);
+        total_nodes += nodes;
+        printf("Ply %2d: %9zu positions, %14llu nodes, %8.1f s\n", ply, counts[ply],
+               (unsigned long long)nodes, (now_us() - start) / 1e6);
+        fflush(stdout);
+        if (!deepest) free(levels[ply + 1]);
+    }
+    free(levels[0]);
+
+    table_free(&table);
+
+    bool written = book_write(output, records, total, depth, child_scores);
+    if (written) {
+        printf("Wrote %zu entries to '%s' in %.1f s (%llu nodes).\n", total, output,
+               (now_us() - build_start) / 1e6, (unsigned long long)total_nodes);
+    }
+    free(records);
+    return written ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include "c4solver.h"
+#include "engine.h"
+#include "bitboard.h"
+#include "table.h"
+#include "book.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+_Static_assert(C4_WIDTH == WIDTH, "The public board width must match the engine's.");
+_Static_assert(C4_INVALID_SCORE == INVALID_MOVE_SCORE, "The public invalid score must match the engine's.");
+
+struct C4Book {
+    Book book;
+};
+
+struct C4Solver {
+    TransTable table;
+    SearchContext ctx; // Searches with the table above, so the solver must not move
+};
+
+// Allocates zeroed memory, aborting on failure.
+static void* checked_calloc(size_t size) {
+    void* memory = calloc(1, size);
+    if (!memory) {
+        fprintf(stderr, "Error: Failed to allocate memory for the solver.\n");
+        abort();
+    }
+    return memory;
+}
+
+// Plays a move string on an empty board, returning false if it is not a valid position
+// without a win for either player.
+static bool parse_position(GameState* game, const char* moves) {
+    char message[128]; // The reason is not reported through the status.
+    return parse_moves(game, moves, message, sizeof(message)) == NULL;
+}
+
+C4Book* c4_book_load(const char* filename) {
+    C4Book* book = (C4Book*)checked_calloc(sizeof(C4Book));
+    if (!book_load(&book->book, filename)) {
+        free(book);
+        return NULL;
+    }
+    return book;
+}
+
+void c4_book_free(C4Book* book) {
+    if (!book) return;
+    book_free(&book->book);
+    free(book);
+}
+
+C4Solver* c4_solver_new(const C4SolverOptions* options) {
+    size_t table_mb = options && options->table_mb ? options->table_mb : DEFAULT_TABLE_MB;
+    const Book* book = options && options->book ? &options->book->book : NULL;
+
+    C4Solver* solver = (C4Solver*)checked_calloc(sizeof(C4Solver));
+    table_init(&solver->table, table_mb);
+    init_search_context(&solver->ctx, &solver->table, book);
+    // Use the engine's defaults whatever the process-wide settings are.
+    solver->ctx.driver = SEARCH_BISECTION;
+    solver->ctx.dynamic_ordering = false;
+    return solver;
+}
+
+void c4_free(C4Solver* solver) {
+    if (!solver) return;
+    table_free(&solver->table);
+    free(solver);
+}
+
+void c4_clear(C4Solver* solver) {
+    table_reset(&solver->table);
+    history_reset(&solver->ctx.ordering);
+}
+
+C4Status c4_solve(C4Solver* solver, const char* moves, bool weak, int* score) {
+    GameState state;
+    solver->ctx.nodes = 0;
+    if (!parse_position(&state, moves)) return C4_INVALID_POSITION;
+    *score = solve_in_context(&solver->ctx, &state, weak);
+    return C4_OK;
+}
+
+C4Status c4_best_move(C4Solver* solver, const char* moves, int* column, int scores[C4_WIDTH]) {
+    GameState state;
+    solver->ctx.nodes = 0;
+    if (!parse_position(&state, moves)) return C4_INVALID_POSITION;
+    int move = scores ? score_moves_in_context(&solver->ctx, &state, scores)
+                      : find_best_move_in_context(&solver->ctx, &state);
+    if (move < 0) return C4_NO_MOVE;
+    *column = move;
+    return C4_OK;
+}
+
+uint64_t c4_nodes(const C4Solver* solver) {
+    return solver->ctx.nodes;
+}
+
+const char* c4_status_string(C4Status status) {
+    switch (status) {
+    case C4_OK: return "ok";
+    case C4_INVALID_POSITION: return "invalid position";
+    case C4_NO_MOVE: return "no move is possible";
+    }
+    return "unknown status";
+}
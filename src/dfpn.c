@@ -0,0 +1,346 @@
+#include "dfpn.h"
+#include "weak.h"
+#include "table.h"
+#include "ordering.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number of bits in the board key.
+#define KEY_SIZE (WIDTH * PHEIGHT)
+
+// Proof and disproof numbers of a solved position. Unsolved positions have numbers
+// below DFPN_INF, and sums saturate just below it.
+#define DFPN_INF UINT32_MAX
+
+// Layout of an entry's tag, from the least significant bit:
+//   [0, 50)  the position key shifted left by one, and the target in the low bit
+//   [50, 56) log2 of the number of nodes expanded to compute the entry
+//   [56, 64) the generation that wrote the entry
+#define TAG_KEY_BITS (KEY_SIZE + 1)
+#define TAG_WORK_SHIFT TAG_KEY_BITS
+#define TAG_WORK_BITS 6
+#define TAG_GENERATION_SHIFT (TAG_WORK_SHIFT + TAG_WORK_BITS)
+#define TAG_GENERATION_BITS (64 - TAG_GENERATION_SHIFT)
+
+#define DFPN_BUCKET_SIZE 4
+#define CACHE_LINE_SIZE 64
+
+// Odd multiplier used to hash keys, as in the exact solver's table.
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+// Largest number of buckets, as a power of two.
+#define MAX_LOG_BUCKETS 34
+
+// One entry: a position and target, with the proof and disproof numbers of the
+// statement "the player to move scores at least the target".
+typedef struct {
+    uint64_t tag;
+    uint32_t proof;
+    uint32_t disproof;
+} DfpnEntry;
+
+typedef struct DfpnBucket {
+    DfpnEntry entries[DFPN_BUCKET_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE))) DfpnBucket;
+
+// Assert that a bucket fills exactly one cache line.
+_Static_assert(sizeof(DfpnBucket) == CACHE_LINE_SIZE, "A proof-number bucket must fill exactly one cache line.");
+// Assert that every tag field fits.
+_Static_assert(TAG_GENERATION_BITS >= 8, "The tag has no room for the generation.");
+
+// Proof and disproof numbers of a node or of one of its children.
+typedef struct {
+    uint32_t proof;
+    uint32_t disproof;
+} ProofNumbers;
+
+// Returns the tag bits identifying a position and target.
+static inline uint64_t tag_key(uint64_t key, int target) {
+    return (key << 1) | (uint64_t)target;
+}
+
+// Returns the bucket of a position and target.
+static inline DfpnBucket* get_bucket(const DfpnTable* table, uint64_t tagged_key) {
+    return &table->buckets[(tagged_key * HASH_MULTIPLIER) >> table->index_shift];
+}
+
+// Returns the size of the table's storage in bytes.
+static size_t dfpn_table_bytes(const DfpnTable* table) {
+    return table->num_buckets * sizeof(DfpnBucket);
+}
+
+// Initializes a proof-number table.
+void dfpn_table_init(DfpnTable* table, size_t size_mb) {
+    assert(table != NULL);
+    if (size_mb < MIN_DFPN_TABLE_MB) size_mb = MIN_DFPN_TABLE_MB;
+    int log_buckets = 0;
+    while (log_buckets < MAX_LOG_BUCKETS && (sizeof(DfpnBucket) << (log_buckets + 1)) <= (size_mb << 20)) {
+        log_buckets++;
+    }
+    table->num_buckets = (size_t)1 << log_buckets;
+    table->index_shift = 64 - log_buckets;
+    table->generation = 1; // Zeroed entries belong to generation 0, so they start out empty.
+
+    table->buckets = (DfpnBucket*)table_alloc_memory(dfpn_table_bytes(table), &table->mapped);
+    if (table->buckets == NULL) {
+        fprintf(stderr, "Error: Failed to allocate a %zu MB proof-number table.\n", dfpn_table_bytes(table) >> 20);
+        abort();
+    }
+}
+
+// Clears the table by starting a new generation. Entries are only wiped for real when
+// the counter wraps around.
+void dfpn_table_reset(DfpnTable* table) {
+    assert(table != NULL && table->buckets != NULL);
+    table->generation = (table->generation + 1) & ((1u << TAG_GENERATION_BITS) - 1);
+    if (table->generation == 0) {
+        memset(table->buckets, 0, dfpn_table_bytes(table));
+        table->generation = 1;
+    }
+}
+
+// Frees the memory used by a proof-number table.
+void dfpn_table_free(DfpnTable* table) {
+    assert(table != NULL);
+    table_free_memory(table->buckets, dfpn_table_bytes(table), table->mapped);
+    table->buckets = NULL;
+    table->num_buckets = 0;
+}
+
+// Returns the part of a tag that must match for an entry to be current and about a given key.
+static inline uint64_t tag_identity(uint64_t tag) {
+    return tag & ~(((1ULL << TAG_WORK_BITS) - 1) << TAG_WORK_SHIFT);
+}
+
+// Retrieves the numbers stored for a position and target. Returns false if there are none.
+static bool dfpn_table_get(const DfpnTable* table, uint64_t key, int target, ProofNumbers* numbers) {
+    uint64_t tagged_key = tag_key(key, target);
+    uint64_t identity = tagged_key | ((uint64_t)table->generation << TAG_GENERATION_SHIFT);
+    const DfpnBucket* bucket = get_bucket(table, tagged_key);
+    for (int i = 0; i < DFPN_BUCKET_SIZE; i++) {
+        if (tag_identity(bucket->entries[i].tag) == identity) {
+            numbers->proof = bucket->entries[i].proof;
+            numbers->disproof = bucket->entries[i].disproof;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stores the numbers of a position and target, which took 2^work_log nodes to compute.
+// The entry replaces an earlier one for the same position, an entry of an older
+// generation, or else the entry that took the least work.
+static void dfpn_table_put(DfpnTable* table, uint64_t key, int target, ProofNumbers numbers, int work_log) {
+    uint64_t tagged_key = tag_key(key, target);
+    uint64_t identity = tagged_key | ((uint64_t)table->generation << TAG_GENERATION_SHIFT);
+    DfpnBucket* bucket = get_bucket(table, tagged_key);
+
+    DfpnEntry* victim = NULL;
+    int victim_work = 1 << TAG_WORK_BITS; // More than any stored work.
+    for (int i = 0; i < DFPN_BUCKET_SIZE; i++) {
+        DfpnEntry* entry = &bucket->entries[i];
+        if (tag_identity(entry->tag) == identity) {
+            victim = entry;
+            break;
+        }
+        int work = (entry->tag >> TAG_GENERATION_SHIFT) != table->generation
+                       ? -1 // Entries of other generations are free.
+                       : (int)((entry->tag >> TAG_WORK_SHIFT) & ((1u << TAG_WORK_BITS) - 1));
+        if (work < victim_work) {
+            victim = entry;
+            victim_work = work;
+        }
+    }
+
+    if (work_log > (1 << TAG_WORK_BITS) - 1) work_log = (1 << TAG_WORK_BITS) - 1;
+    victim->tag = identity | ((uint64_t)work_log << TAG_WORK_SHIFT);
+    victim->proof = numbers.proof;
+    victim->disproof = numbers.disproof;
+}
+
+// Prefetches the bucket of a position and target.
+static inline void dfpn_table_prefetch(const DfpnTable* table, uint64_t key, int target) {
+    __builtin_prefetch(get_bucket(table, tag_key(key, target)));
+}
+
+void init_dfpn_context(DfpnContext* ctx, DfpnTable* table, const Book* book) {
+    assert(ctx != NULL && table != NULL);
+    ctx->table = table;
+    ctx->book = book;
+    ctx->nodes = 0;
+    // Break ties toward center columns, which are generally stronger.
+    for (int i = 0; i < WIDTH; i++) {
+        ctx->column_order[i] = WIDTH / 2 + (1 - 2 * (i % 2)) * ((i + 1) / 2);
+    }
+}
+
+// Numbers of a statement that holds.
+static const ProofNumbers PROVEN = { 0, DFPN_INF };
+// Numbers of a statement that fails.
+static const ProofNumbers DISPROVEN = { DFPN_INF, 0 };
+
+// Returns the numbers of the statement "the player to move in S scores at least target"
+// when they can be found without expanding the position: because the game is over,
+// the score is out of reach, the book knows the score, or the table holds the numbers.
+// Otherwise returns first estimates: one move may be enough to prove the statement,
+// but every move must be refuted to disprove it. The player to move must not have a
+// winning move.
+static ProofNumbers evaluate(const DfpnContext* ctx, const SearchState* S, int target) {
+    const GameState* P = &S->pos;
+    if (is_draw(P)) {
+        return target <= 0 ? PROVEN : DISPROVEN;
+    }
+
+    uint64_t possible = search_state_non_losing_moves(S);
+    if (possible == 0) { // No move stops the opponent from winning.
+        return DISPROVEN;
+    }
+
+    // The score is between the slowest possible loss and the quickest possible win.
+    if (target > (WIDTH * HEIGHT - 1 - P->moves) / 2) return DISPROVEN;
+    if (target <= -(WIDTH * HEIGHT - 2 - P->moves) / 2) return PROVEN;
+
+    // Shallow positions may have their exact score in the book.
+    int exact;
+    if (ctx->book && P->moves < ctx->book->depth && book_lookup_score(ctx->book, P, &exact)) {
+        return exact >= target ? PROVEN : DISPROVEN;
+    }
+
+    ProofNumbers numbers;
+    if (dfpn_table_get(ctx->table, get_canonical_key(P), target, &numbers)) {
+        return numbers;
+    }
+
+    int moves = 0;
+    for (int col = 0; col < WIDTH; col++) {
+        moves += (possible & column_mask(col)) != 0;
+    }
+    return (ProofNumbers){ 1, (uint32_t)moves };
+}
+
+// Returns a + b, saturated below DFPN_INF.
+static inline uint32_t add_numbers(uint32_t a, uint32_t b) {
+    uint64_t sum = (uint64_t)a + b;
+    return sum >= DFPN_INF ? DFPN_INF - 1 : (uint32_t)sum;
+}
+
+// Expands the position in S until its proof number reaches proof_limit or its disproof
+// number reaches disproof_limit, and returns its numbers for the statement "the player
+// to move scores at least target". A move proves the statement if it disproves the
+// opponent's statement for 1 - target, so the proof number of a position is the least
+// disproof number of its moves, and its disproof number the sum of their proof numbers.
+// The search descends into the move with the least disproof number, with limits that
+// return control as soon as another move becomes cheaper. Moves are played and taken
+// back in place, so S holds the same position again when the call returns.
+static ProofNumbers dfpn_search(DfpnContext* ctx, SearchState* S, int target,
+                                uint32_t proof_limit, uint32_t disproof_limit) {
+    const GameState* P = &S->pos;
+    assert(!can_win_next(P)); // Winning positions are resolved without expanding them.
+
+    ctx->nodes++;
+    const uint64_t start_nodes = ctx->nodes;
+    const int child_target = 1 - target;
+
+    // Order moves by the threats they create, center first among equals.
+    uint64_t possible = search_state_non_losing_moves(S);
+    uint64_t moves[WIDTH];
+    int count = 0;
+    for (int i = WIDTH; i-- > 0; ) {
+        uint64_t move = possible & column_mask(ctx->column_order[i]);
+        if (move) moves[count++] = move;
+    }
+    assert(count > 0); // Positions without a non-losing move are resolved without expanding them.
+    uint64_t move_threats[WIDTH];
+    int threat_counts[WIDTH];
+    score_moves_batch(S, moves, count, move_threats, threat_counts);
+
+    MoveSorter sorter;
+    sorter_init(&sorter);
+    uint64_t child_threats[WIDTH];
+    for (int j = 0; j < count; j++) {
+        GameState child = { P->current_position ^ P->mask, P->mask | moves[j], P->moves + 1 };
+        dfpn_table_prefetch(ctx->table, get_canonical_key(&child), child_target);
+        child_threats[bitboard_to_col(moves[j])] = move_threats[j];
+        sorter_add(&sorter, moves[j], threat_counts[j]);
+    }
+
+    // Evaluate every move once. Afterwards, only the move being searched changes.
+    const uint64_t threats = S->threats;
+    uint64_t ordered[WIDTH];
+    ProofNumbers children[WIDTH];
+    count = 0;
+    uint64_t next_move;
+    while ((next_move = sorter_get_next(&sorter))) {
+        search_state_play(S, next_move, child_threats[bitboard_to_col(next_move)]);
+        children[count] = evaluate(ctx, S, child_target);
+        search_state_undo(S, next_move, threats);
+        ordered[count++] = next_move;
+    }
+
+    ProofNumbers numbers;
+    for (;;) {
+        // Find the move with the least disproof number, and the runner-up's number.
+        int best = 0;
+        uint32_t second = DFPN_INF;
+        uint32_t disproof_sum = 0;
+        bool refuted = false; // True if some move has been disproven for the opponent.
+        for (int j = 0; j < count; j++) {
+            if (children[j].disproof < children[best].disproof) {
+                second = children[best].disproof;
+                best = j;
+            } else if (j != best && children[j].disproof < second) {
+                second = children[j].disproof;
+            }
+            refuted |= children[j].proof == DFPN_INF;
+            disproof_sum = add_numbers(disproof_sum, children[j].proof);
+        }
+        numbers.proof = children[best].disproof;
+        numbers.disproof = refuted ? DFPN_INF : disproof_sum;
+        if (numbers.proof == 0) numbers.disproof = DFPN_INF;
+
+        if (numbers.proof >= proof_limit || numbers.disproof >= disproof_limit) break;
+
+        // Search the best move until its disproof number exceeds the runner-up's, or the
+        // sum of proof numbers reaches this position's disproof limit. Letting it run to
+        // 1.5 times the runner-up's number saves switching back and forth between moves of
+        // similar cost, which halves the nodes expanded on Test_L2_R2.
+        uint32_t child_proof_limit = disproof_limit - (numbers.disproof - children[best].proof);
+        uint32_t child_disproof_limit = second == DFPN_INF ? DFPN_INF : add_numbers(second, second / 2 + 1);
+        if (child_disproof_limit > proof_limit) child_disproof_limit = proof_limit;
+
+        uint64_t move = ordered[best];
+        search_state_play(S, move, child_threats[bitboard_to_col(move)]);
+        children[best] = dfpn_search(ctx, S, child_target, child_proof_limit, child_disproof_limit);
+        search_state_undo(S, move, threats);
+    }
+
+    int work_log = 63 - __builtin_clzll(ctx->nodes - start_nodes + 1);
+    dfpn_table_put(ctx->table, get_canonical_key(P), target, numbers, work_log);
+    return numbers;
+}
+
+// Returns true if the player to move in S scores at least target.
+static bool dfpn_prove(DfpnContext* ctx, SearchState* S, int target) {
+    ProofNumbers numbers = evaluate(ctx, S, target);
+    while (numbers.proof != 0 && numbers.disproof != 0) {
+        numbers = dfpn_search(ctx, S, target, DFPN_INF, DFPN_INF);
+    }
+    return numbers.proof == 0;
+}
+
+int dfpn_solve_in_context(DfpnContext* ctx, const GameState* state) {
+    assert(ctx != NULL && state != NULL);
+    if (can_win_next(state)) {
+        return WEAK_WIN;
+    }
+
+    SearchState search;
+    init_search_state(&search, state);
+    if (dfpn_prove(ctx, &search, 1)) {
+        return WEAK_WIN;
+    }
+    return dfpn_prove(ctx, &search, 0) ? WEAK_DRAW : WEAK_LOSS;
+}
@@ -2,15 +2,84 @@
 #include "table.h"
 #include "ordering.h"
 #include "book.h"
+#include "weak.h"
+#include "stats.h"
+#include "util.h"
 
 #include <assert.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+// Maximum number of threads that can search a single position.
+#define MAX_SEARCH_THREADS 256
+
+// Nodes searched between two checks of a context's time and node limits.
+#define LIMIT_CHECK_INTERVAL 1024
+// Heuristic values beyond this are wins or losses found within the search horizon.
+#define HEURISTIC_WIN 1000
+// An anytime search gives its heuristic search this fraction of the budget: 1/4.
+#define HEURISTIC_BUDGET_DIVISOR 4
+
+// A helper thread taking part in a parallel solve or root search.
+typedef struct {
+    pthread_t thread;
+    SearchContext ctx;
+    const GameState* state;
+    bool weak;
+    int guess;          // Guess of the score for a score search, or NO_SCORE_GUESS
+    bool root;          // Search for the best move instead of the score
+    int* scores;        // Receives the score of every column in a root search, or NULL
+    int score;          // Result of a score search
+    int move;           // Result of a root search
+    bool finished;      // True if this thread completed the search first
+    SearchStats stats;  // The thread's search statistics, in builds that count them
+} SearchWorker;
 
 // Engine State
 uint64_t g_nodes_searched;
-static int column_order[WIDTH];
+uint64_t g_researches;
+static int g_search_threads = 1;
+// Initial driver of new search contexts.
+static SearchDriver g_search_driver = SEARCH_BISECTION;
+// Initial dynamic_ordering setting of new search contexts.
+static bool g_dynamic_ordering = false;
+// Stop flag for contexts that are never asked to abandon their search.
+static bool g_never_stop = false;
+
+// Returns true if the context's search has been abandoned.
+static inline bool search_stopped(const SearchContext* ctx) {
+    return __atomic_load_n(ctx->stop, __ATOMIC_RELAXED);
+}
+
+// Stops the context's search if it has used up its nodes or time, and otherwise
+// schedules the next check.
+static void check_limits(SearchContext* ctx) {
+    if (ctx->nodes >= ctx->node_limit || (ctx->deadline_us && now_us() >= ctx->deadline_us)) {
+        __atomic_store_n(ctx->stop, true, __ATOMIC_RELAXED);
+        ctx->next_check = UINT64_MAX;
+        return;
+    }
+    uint64_t next = ctx->nodes + LIMIT_CHECK_INTERVAL;
+    ctx->next_check = next < ctx->node_limit ? next : ctx->node_limit;
+}
+
+// Sets the limits of a context's search: a monotonic deadline, or 0 for none, and a value
+// of its node counter, or UINT64_MAX for none. They are first checked at the next node.
+static void set_limits(SearchContext* ctx, long long deadline_us, uint64_t node_limit) {
+    ctx->deadline_us = deadline_us;
+    ctx->node_limit = node_limit;
+    ctx->next_check = ctx->nodes;
+}
+
+// Removes the limits of a context's search.
+static void clear_limits(SearchContext* ctx) {
+    ctx->deadline_us = 0;
+    ctx->node_limit = UINT64_MAX;
+    ctx->next_check = UINT64_MAX;
+}
 
 // Score Encoding/Decoding for Transposition Table
 /**
@@ -50,19 +119,110 @@ static inline bool is_lower_bound(uint8_t val) {
     return val >= MAX_SCORE - MIN_SCORE + 2;
 }
 
+// Sorter score given to the table's best move, above any heuristic score, so that it is tried first.
+#define HASH_MOVE_SCORE INT_MAX
+
+// Enhanced transposition cutoffs are tried in positions with fewer moves than this.
+// Closer to the leaves, the probes cost more than the subtrees they prune.
+#define ETC_MAX_MOVES 24
+// Weak searches probe their children down to here: the weak table holds more entries per
+// cache line, so its probes pay off for longer.
+#define WEAK_ETC_MAX_MOVES 36
+
 // Private Functions
-static int negamax(const GameState* P, int alpha, int beta) {
+
+// Looks up the exact score of a position within the depth of the context's book.
+static inline bool book_score(const SearchContext* ctx, const GameState* P, int* score) {
+    if (ctx->book && P->moves < ctx->book->depth && book_lookup_score(ctx->book, P, score)) {
+        STATS_INC(book_hits);
+        return true;
+    }
+    return false;
+}
+
+// Varies a context so that it explores different parts of the tree first than the
+// other threads searching the same position, filling the shared table for them.
+static void diversify_context(SearchContext* ctx, int thread_id) {
+    if (thread_id % 2 == 1) {
+        // Prefer the right-hand column of each pair equidistant from the center.
+        for (int i = 1; i + 1 < WIDTH; i += 2) {
+            int tmp = ctx->column_order[i];
+            ctx->column_order[i] = ctx->column_order[i + 1];
+            ctx->column_order[i + 1] = tmp;
+        }
+    }
+    ctx->unbiased_pivot = (thread_id / 2) % 2 == 1;
+}
+
+// Converts an outcome bound of the weak table to a bound on the score. Sets lower to
+// true for a lower bound, and to false for an upper bound.
+static inline int weak_bound_score(int bound, bool* lower) {
+    *lower = bound == WEAK_BOUND_WIN || bound == WEAK_BOUND_NOT_LOSS;
+    return bound == WEAK_BOUND_WIN ? 1 : bound == WEAK_BOUND_LOSS ? -1 : 0;
+}
+
+// Looks up the bound stored for a key. Returns false if there is none, and otherwise
+// sets lower to the kind of bound and stores the table's best move, if any, in hash_move.
+static inline __attribute__((always_inline))
+bool probe_bound(const SearchContext* ctx, const WeakTable* weak_table, uint64_t key, bool weak,
+                 int* score, bool* lower, int* hash_move) {
+    if (weak) {
+        int bound = weak_table_get(weak_table, key);
+        if (bound < 0) return false;
+        *score = weak_bound_score(bound, lower);
+        return true;
+    }
+    uint8_t val = table_get(ctx->table, key, hash_move);
+    if (val == 0) return false;
+    *lower = is_lower_bound(val);
+    *score = *lower ? decode_lower_bound(val) : decode_upper_bound(val);
+    return true;
+}
+
+// Stores a bound for a key, with the move that produced it or -1. The weak table only
+// keeps bounds that tell the outcome, and no move.
+static inline __attribute__((always_inline))
+void store_bound(SearchContext* ctx, WeakTable* weak_table, uint64_t key, bool weak,
+                 int score, bool lower, int moves, int move) {
+    if (!weak) {
+        table_put(ctx->table, key, lower ? encode_lower_bound(score) : encode_upper_bound(score), moves, move);
+    } else if (lower && score >= 0) {
+        weak_table_put(weak_table, key, score >= 1 ? WEAK_BOUND_WIN : WEAK_BOUND_NOT_LOSS);
+    } else if (!lower && score <= 0) {
+        weak_table_put(weak_table, key, score <= -1 ? WEAK_BOUND_LOSS : WEAK_BOUND_NOT_WIN);
+    }
+}
+
+static int negamax(SearchContext* ctx, SearchState* S, int alpha, int beta);
+static int weak_negamax(SearchContext* ctx, WeakTable* weak_table, SearchState* S, int alpha, int beta);
+
+// Searches the position in S within (alpha, beta). Moves are played and taken back in
+// place, so S holds the same position again when the call returns. The core is compiled
+// twice: negamax() searches with the exact table, and weak_negamax() only answers
+// outcome questions with null windows, storing 2-bit outcome bounds in weak_table.
+static inline __attribute__((always_inline))
+int search_node(SearchContext* ctx, WeakTable* weak_table, SearchState* S, int alpha, int beta, const bool weak) {
+    const GameState* P = &S->pos;
     assert(alpha < beta);
+    assert(!weak || alpha + 1 == beta); // Outcome questions are asked with null windows.
     assert(!can_win_next(P)); // The parent should have already checked for winning moves.
 
-    g_nodes_searched++;
+    // Another thread has already solved the position; the returned value is discarded.
+    if (search_stopped(ctx)) {
+        return 0;
+    }
+
+    ctx->nodes++;
+    if (ctx->nodes >= ctx->next_check) check_limits(ctx);
+    STATS_INC(nodes);
+    STATS_INC(nodes_by_ply[P->moves]);
 
     if (is_draw(P)) {
         return 0;
     }
 
     // We can prune moves that let the opponent win on the next turn.
-    uint64_t possible = possible_non_losing_moves(P);
+    uint64_t possible = search_state_non_losing_moves(S);
     if (possible == 0) { // If no non-losing moves, we lose.
         return -((WIDTH * HEIGHT - P->moves) / 2);
     }
@@ -79,65 +239,159 @@ static int negamax(const GameState* P, int alpha, int beta) {
         if (alpha >= beta) return beta;
     }
     
-    // Probe the transposition table for a stored score.
-    const uint64_t key = get_key(P);
-    uint8_t val = table_get(key);
-    if (val != 0) {
-        if (is_lower_bound(val)) { // We have a lower bound.
-            int lower_bound = decode_lower_bound(val);
-            if (alpha < lower_bound) {
-                alpha = lower_bound;
-                if (alpha >= beta) return alpha;
+    // Shallow positions may have their exact score in the book, which ends the search here.
+    int exact;
+    if (book_score(ctx, P, &exact)) {
+        return exact;
+    }
+
+    // Probe the transposition table for a stored score and best move.
+    // Mirrored positions share an entry, since they have the same score; the move
+    // is stored for the canonical orientation.
+    const uint64_t key = get_canonical_key(P);
+    const bool mirrored = key != get_key(P);
+    int hash_move = -1;
+    int bound;
+    bool lower;
+    bool found = probe_bound(ctx, weak_table, key, weak, &bound, &lower, &hash_move);
+    if (hash_move >= 0 && mirrored) {
+        hash_move = WIDTH - 1 - hash_move;
+    }
+    if (found) {
+        if (lower) { // We have a lower bound.
+            if (alpha < bound) {
+                alpha = bound;
+                if (alpha >= beta) {
+                    STATS_INC(tt_cutoffs);
+                    return alpha;
+                }
             }
         } else { // We have an upper bound.
-            int upper_bound = decode_upper_bound(val);
-            if (beta > upper_bound) {
-                beta = upper_bound;
-                if (alpha >= beta) return beta;
+            if (beta > bound) {
+                beta = bound;
+                if (alpha >= beta) {
+                    STATS_INC(tt_cutoffs);
+                    return beta;
+                }
             }
         }
     }
 
-    // Order moves to improve alpha-beta pruning efficiency.
-    MoveSorter sorter;
-    sorter_init(&sorter);
+    // Order moves to improve alpha-beta pruning efficiency. The move that was best
+    // or caused a cutoff the last time this position was searched goes first, then
+    // moves by threat count, adjusted by killer moves and history if enabled.
+    // All candidate moves are scored in one batch. The threats each move creates are
+    // kept to play the move later.
+    uint64_t moves[WIDTH];
+    int ranks[WIDTH];
+    int count = 0;
     for (int i = WIDTH; i-- > 0; ) {
-        uint64_t move = possible & column_mask(column_order[i]);
+        uint64_t move = possible & column_mask(ctx->column_order[i]);
         if (move) {
-            sorter_add(&sorter, move, move_score(P, move));
+            moves[count] = move;
+            ranks[count++] = i;
+        }
+    }
+    uint64_t move_threats[WIDTH];
+    int threat_counts[WIDTH];
+    score_moves_batch(S, moves, count, move_threats, threat_counts);
+
+    // Prefetch the children's table buckets, so that their cache misses overlap with
+    // each other and with the move ordering instead of stalling each child's probe.
+    uint64_t child_keys[WIDTH];
+    for (int j = 0; j < count; j++) {
+        GameState child = { P->current_position ^ P->mask, P->mask | moves[j], P->moves + 1 };
+        child_keys[j] = get_canonical_key(&child);
+        if (weak) {
+            weak_table_prefetch(weak_table, child_keys[j]);
+        } else {
+            table_prefetch(ctx->table, child_keys[j]);
+        }
+    }
+    MoveSorter sorter;
+    sorter_init(&sorter);
+    uint64_t child_threats[WIDTH];
+    for (int j = 0; j < count; j++) {
+        int col = ctx->column_order[ranks[j]];
+        child_threats[col] = move_threats[j];
+        int score = col == hash_move ? HASH_MOVE_SCORE
+                  : ctx->dynamic_ordering ? history_move_score(&ctx->ordering, P->moves, moves[j], threat_counts[j], ranks[j])
+                  : threat_counts[j];
+        sorter_add(&sorter, moves[j], score);
+    }
+
+    // Enhanced transposition cutoffs: a child whose stored upper bound already refutes
+    // the window ends the search before recursing into any child.
+    if (P->moves < (weak ? WEAK_ETC_MAX_MOVES : ETC_MAX_MOVES)) {
+        for (int j = 0; j < count; j++) {
+            int child_bound;
+            bool child_lower;
+            if (!probe_bound(ctx, weak_table, child_keys[j], weak, &child_bound, &child_lower, NULL) || child_lower) {
+                continue;
+            }
+            int score = -child_bound;
+            if (score >= beta) {
+                int col = ctx->column_order[ranks[j]];
+                store_bound(ctx, weak_table, key, weak, score, true, P->moves, mirrored ? WIDTH - 1 - col : col);
+                STATS_INC(etc_cutoffs);
+                return score;
+            }
         }
     }
 
     // The loop over moves.
+    const uint64_t threats = S->threats;
+    int best_move = hash_move;
     uint64_t next_move;
     while ((next_move = sorter_get_next(&sorter))) {
-        GameState P2 = *P;
-        play_move(&P2, bitboard_to_col(next_move));
+        int col = bitboard_to_col(next_move);
 
         // Recursive call for the opponent with a flipped score and window.
-        int score = -negamax(&P2, -beta, -alpha);
+        search_state_play(S, next_move, child_threats[col]);
+        int score = weak ? -weak_negamax(ctx, weak_table, S, -beta, -alpha) : -negamax(ctx, S, -beta, -alpha);
+        search_state_undo(S, next_move, threats);
+
+        // Never store a score from an abandoned search in the table.
+        if (search_stopped(ctx)) {
+            return 0;
+        }
 
         if (score >= beta) {
-            // Store a lower bound in the transposition table.
-            table_put(key, encode_lower_bound(score));
+            STATS_INC(cutoffs);
+            STATS_INC(cutoffs_by_ply[P->moves]);
+            STATS_INC(cutoffs_by_index[count - 1 - sorter.size]); // The sorter hands out moves from its end.
+            if (ctx->dynamic_ordering) history_record_cutoff(&ctx->ordering, P->moves, next_move);
+            // Store a lower bound and the cutoff move in the transposition table.
+            store_bound(ctx, weak_table, key, weak, score, true, P->moves, mirrored ? WIDTH - 1 - col : col);
             return score; // Beta-cutoff: opponent will avoid this line.
         }
         if (score > alpha) {
             alpha = score; // Found a new best move.
+            best_move = col;
         }
     }
 
-    // Store the final alpha value (an upper bound) and return it.
-    table_put(key, encode_upper_bound(alpha));
+    // Store the final alpha value (an upper bound) and return it. If no move raised
+    // alpha, the previous best move is kept.
+    if (best_move >= 0 && mirrored) {
+        best_move = WIDTH - 1 - best_move;
+    }
+    store_bound(ctx, weak_table, key, weak, alpha, false, P->moves, best_move);
     return alpha;
 }
 
+// Searches with the exact table, as search_node().
+static int negamax(SearchContext* ctx, SearchState* S, int alpha, int beta) {
+    return search_node(ctx, NULL, S, alpha, beta, false);
+}
+
+// Searches a null window with the weak table, as search_node().
+static int weak_negamax(SearchContext* ctx, WeakTable* weak_table, SearchState* S, int alpha, int beta) {
+    return search_node(ctx, weak_table, S, alpha, beta, true);
+}
+
 // Public API Implementations
 void init_solver(void) {
-    // Initialize column order to check center columns first, which are generally stronger.
-    for (int i = 0; i < WIDTH; i++) {
-        column_order[i] = WIDTH / 2 + (1 - 2 * (i % 2)) * ((i + 1) / 2);
-    }
     reset_solver();
     init_book();
     atexit(free_book); // Ensure memory is freed on exit.
@@ -145,30 +399,84 @@ void init_solver(void) {
 
 void reset_solver(void) {
     g_nodes_searched = 0;
+    g_researches = 0;
 }
 
-int solve(const GameState* state, bool weak) {
-    // If we can win on the next move, return the score for the fastest win.
-    if (can_win_next(state)) {
-        return (WIDTH * HEIGHT + 1 - state->moves) / 2;
+// Initializes a context, which may have no exact table when it runs weak searches.
+static void init_context(SearchContext* ctx, TransTable* table, const Book* book) {
+    ctx->table = table;
+    ctx->book = book;
+    ctx->nodes = 0;
+    // Check center columns first, which are generally stronger.
+    for (int i = 0; i < WIDTH; i++) {
+        ctx->column_order[i] = WIDTH / 2 + (1 - 2 * (i % 2)) * ((i + 1) / 2);
     }
+    ctx->unbiased_pivot = false;
+    ctx->driver = g_search_driver;
+    ctx->researches = 0;
+    ctx->dynamic_ordering = g_dynamic_ordering;
+    history_reset(&ctx->ordering);
+    ctx->stop = &g_never_stop;
+    clear_limits(ctx);
+}
 
-    // Set the initial score search range.
-    int min = -(WIDTH * HEIGHT - state->moves) / 2;
-    int max = (WIDTH * HEIGHT + 1 - state->moves) / 2;
-    if (weak) { // A "weak" solve only checks for win/loss/draw.
-        min = -1;
-        max = 1;
+void init_search_context(SearchContext* ctx, TransTable* table, const Book* book) {
+    assert(ctx != NULL && table != NULL);
+    init_context(ctx, table, book);
+}
+
+void set_search_limits(SearchContext* ctx, const SearchLimits* limits) {
+    if (!limits || (limits->time_us <= 0 && limits->nodes == 0)) {
+        clear_limits(ctx);
+        return;
     }
+    set_limits(ctx, limits->time_us > 0 ? now_us() + limits->time_us : 0,
+               limits->nodes > 0 ? ctx->nodes + limits->nodes : UINT64_MAX);
+}
+
+void set_search_threads(int threads) {
+    if (threads < 1) threads = 1;
+    if (threads > MAX_SEARCH_THREADS) threads = MAX_SEARCH_THREADS;
+    g_search_threads = threads;
+}
+
+void set_dynamic_ordering(bool enabled) {
+    g_dynamic_ordering = enabled;
+}
+
+void set_search_driver(SearchDriver driver) {
+    g_search_driver = driver;
+}
+
+// Returns a guess of a position's score from its table entry: the stored bound, which
+// is the nearest score the entry allows. Returns NO_SCORE_GUESS if there is no entry.
+static int table_guess(const SearchContext* ctx, const GameState* state) {
+    uint8_t val = table_get(ctx->table, get_canonical_key(state), NULL);
+    if (val == 0) return NO_SCORE_GUESS;
+    return is_lower_bound(val) ? decode_lower_bound(val) : decode_upper_bound(val);
+}
 
-    // Binary search the score to find the exact value.
+// Binary searches the score of a position that cannot be won on the next move within
+// [min, max], with the pivot biased toward 0 unless the context asks otherwise.
+static int bisect_window(SearchContext* ctx, SearchState* search, int min, int max) {
+    bool first = true;
     while (min < max) {
         int med = min + (max - min) / 2;
-        // Tweak the search pivot to be closer to 0, a more likely score, to speed up convergence.
-        if (med <= 0 && min / 2 < med) med = min / 2;
-        else if (med >= 0 && max / 2 > med) med = max / 2;
+        if (!ctx->unbiased_pivot) {
+            // Tweak the search pivot to be closer to 0, a more likely score, to speed up convergence.
+            if (med <= 0 && min / 2 < med) med = min / 2;
+            else if (med >= 0 && max / 2 > med) med = max / 2;
+        }
 
-        int r = negamax(state, med, med + 1); // Use a minimal window search.
+        if (!first) {
+            ctx->researches++;
+            STATS_INC(researches);
+        }
+        first = false;
+        int r = negamax(ctx, search, med, med + 1); // Use a minimal window search.
+        if (search_stopped(ctx)) {
+            break;
+        }
         if (r > med) {
             min = r; // The score is in [r, max].
         } else {
@@ -178,43 +486,505 @@ int solve(const GameState* state, bool weak) {
     return min;
 }
 
-int find_best_move(const GameState* state) {
+// Finds the score of a position that cannot be won on the next move within [min, max]
+// MTD(f)-style: each null-window search tests whether the score reaches the last
+// result, which with a fail-soft search moves straight to the next bound. A correct
+// guess takes two searches, one proving each bound.
+static int mtdf_window(SearchContext* ctx, SearchState* search, int min, int max, int guess) {
+    int g = guess < min ? min : guess > max ? max : guess;
+    bool first = true;
+    while (min < max) {
+        int beta = g <= min ? min + 1 : g; // Test whether the score is at least beta.
+
+        if (!first) {
+            ctx->researches++;
+            STATS_INC(researches);
+        }
+        first = false;
+        int r = negamax(ctx, search, beta - 1, beta);
+        if (search_stopped(ctx)) {
+            break;
+        }
+        if (r >= beta) {
+            min = r; // The score is in [r, max].
+        } else {
+            max = r; // The score is in [min, r].
+        }
+        g = r;
+    }
+    return min;
+}
+
+// Finds the score of a position that cannot be won on the next move within [min, max]
+// with the context's driver. Returns the exact score if it lies in that range, and
+// otherwise the nearest end of the range. Returns early, with a meaningless score, if
+// another thread solves the position first. MTD(f) starts from the guess, or from the
+// position's table entry if there is none. Without either, it falls back to bisection:
+// from a poor guess, its fail-soft steps can take many more searches.
+static int search_window(SearchContext* ctx, const GameState* state, int min, int max, int guess) {
+    SearchState search;
+    init_search_state(&search, state);
+    if (ctx->driver == SEARCH_MTDF && guess == NO_SCORE_GUESS) {
+        guess = table_guess(ctx, state);
+    }
+    if (ctx->driver == SEARCH_BISECTION || guess == NO_SCORE_GUESS) {
+        return bisect_window(ctx, &search, min, max);
+    }
+    return mtdf_window(ctx, &search, min, max, guess);
+}
+
+// Finds the score of a position that cannot be won on the next move. Returns early,
+// with a meaningless score, if another thread solves the position first.
+static int search_score(SearchContext* ctx, const GameState* state, bool weak, int guess) {
+    int exact;
+    if (book_score(ctx, state, &exact)) {
+        return weak ? (exact > 0) - (exact < 0) : exact;
+    }
+
+    // Set the initial score search range.
+    int min = -(WIDTH * HEIGHT - state->moves) / 2;
+    int max = (WIDTH * HEIGHT + 1 - state->moves) / 2;
+    if (weak) { // A "weak" solve only checks for win/loss/draw.
+        int score = search_window(ctx, state, -1, 1, guess);
+        return (score > 0) - (score < 0); // The search is fail-soft, so clamp to the outcome.
+    }
+    return search_window(ctx, state, min, max, guess);
+}
+
+// Finds the best move with one search over the root moves, the likeliest first.
+// Once a best move is known, each later move only needs one null-window search
+// proving that it does no better, and is solved exactly only if it does. If scores
+// is not NULL, every move is solved exactly and its score stored there instead.
+// Returns -1 if no move is possible, or early with a meaningless move if another
+// thread finishes first.
+static int search_root(SearchContext* ctx, const GameState* state, int scores[WIDTH]) {
+    if (scores) {
+        for (int col = 0; col < WIDTH; col++) scores[col] = INVALID_MOVE_SCORE;
+    }
+
+    // Moves that let the opponent win at once go last, the rest in negamax's order.
+    MoveSorter sorter;
+    sorter_init(&sorter);
+    uint64_t non_losing = possible_non_losing_moves(state);
+    for (int i = WIDTH; i-- > 0; ) {
+        uint64_t move = possible(state) & column_mask(ctx->column_order[i]);
+        if (move) {
+            sorter_add(&sorter, move, (move & non_losing) ? move_score(state, move) : -1);
+        }
+    }
+
+    // With MTD(f), the first move, likely the best, starts from the root's own score.
+    int root_guess = ctx->driver == SEARCH_MTDF ? table_guess(ctx, state) : NO_SCORE_GUESS;
+
+    int best_move = -1;
+    int best_score = 0;
+    uint64_t next_move;
+    while ((next_move = sorter_get_next(&sorter))) {
+        int col = bitboard_to_col(next_move);
+        int score;
+        if (is_winning_move(state, col)) {
+            score = (WIDTH * HEIGHT + 1 - state->moves) / 2;
+        } else {
+            GameState child = *state;
+            play_move(&child, col);
+            if (scores || best_move < 0 || can_win_next(&child)) {
+                int guess = best_move < 0 && root_guess != NO_SCORE_GUESS ? -root_guess : NO_SCORE_GUESS;
+                score = -solve_in_context_with_guess(ctx, &child, false, guess);
+            } else {
+                // The move is better only if the child scores below -best_score.
+                int bound = -best_score;
+                SearchState search;
+                init_search_state(&search, &child);
+                int r = negamax(ctx, &search, bound - 1, bound);
+                if (r >= bound) {
+                    if (search_stopped(ctx)) return -1;
+                    continue;
+                }
+                // The child's score is at most r, the bound the failed search proved.
+                ctx->researches++;
+                STATS_INC(researches);
+                int min = -(WIDTH * HEIGHT - child.moves) / 2;
+                score = -search_window(ctx, &child, min, r, r);
+            }
+        }
+        if (search_stopped(ctx)) return -1;
+
+        if (scores) scores[col] = score;
+        if (best_move < 0 || score > best_score) {
+            best_move = col;
+            best_score = score;
+            // Nothing beats an immediate win.
+            if (!scores && score == (WIDTH * HEIGHT + 1 - state->moves) / 2) break;
+        }
+    }
+    return best_move;
+}
+
+// Runs a full search in a helper thread and claims the result if it finishes first.
+static void* search_worker_main(void* arg) {
+    SearchWorker* worker = (SearchWorker*)arg;
+    if (worker->root) {
+        worker->move = search_root(&worker->ctx, worker->state, worker->scores);
+    } else {
+        worker->score = search_score(&worker->ctx, worker->state, worker->weak, worker->guess);
+    }
+    if (!search_stopped(&worker->ctx)) {
+        // Only the first thread to finish may publish its score.
+        worker->finished = !__atomic_exchange_n(worker->ctx.stop, true, __ATOMIC_ACQ_REL);
+    }
+    worker->stats = stats_current();
+    return NULL;
+}
+
+// Searches a position with several threads sharing the transposition table (Lazy SMP).
+// Every thread runs the complete search; the first one to finish stops the others.
+// Returns the worker holding the result. Only the scores of that worker are written.
+static const SearchWorker* search_parallel(SearchWorker* workers, const GameState* state, bool weak,
+                                           int guess, bool root, int* scores) {
+    int num_workers = g_search_threads;
+    bool stop = false; // Shared by all workers; set by the first one to finish.
+    int worker_scores[MAX_SEARCH_THREADS][WIDTH];
+
+    for (int i = 0; i < num_workers; i++) {
+        init_search_context(&workers[i].ctx, default_table(), default_book());
+        diversify_context(&workers[i].ctx, i);
+        workers[i].ctx.stop = &stop;
+        workers[i].state = state;
+        workers[i].weak = weak;
+        workers[i].guess = guess;
+        workers[i].root = root;
+        workers[i].scores = scores ? worker_scores[i] : NULL;
+        workers[i].finished = false;
+    }
+
+    // Start the helpers, then take part in the search from the calling thread.
+    int started = 1;
+    for (; started < num_workers; started++) {
+        if (pthread_create(&workers[started].thread, NULL, search_worker_main, &workers[started]) != 0) {
+            fprintf(stderr, "Warning: Could only start %d search threads.\n", started);
+            break;
+        }
+    }
+    search_worker_main(&workers[0]);
+
+    const SearchWorker* winner = &workers[0];
+    for (int i = 0; i < started; i++) {
+        if (i > 0) {
+            pthread_join(workers[i].thread, NULL);
+            stats_add(&workers[i].stats); // The first worker ran on this thread and counted here.
+        }
+        g_nodes_searched += workers[i].ctx.nodes;
+        g_researches += workers[i].ctx.researches;
+        if (workers[i].finished) winner = &workers[i];
+    }
+    if (scores) {
+        for (int col = 0; col < WIDTH; col++) scores[col] = winner->scores[col];
+    }
+    return winner;
+}
+
+int solve(const GameState* state, bool weak) {
+    return solve_with_guess(state, weak, NO_SCORE_GUESS);
+}
+
+int solve_with_guess(const GameState* state, bool weak, int guess) {
+    // If we can win on the next move, return the score for the fastest win.
+    if (can_win_next(state)) {
+        return weak ? 1 : (WIDTH * HEIGHT + 1 - state->moves) / 2;
+    }
+
+    if (g_search_threads > 1) {
+        SearchWorker workers[MAX_SEARCH_THREADS];
+        return search_parallel(workers, state, weak, guess, false, NULL)->score;
+    }
+
+    SearchContext ctx;
+    init_search_context(&ctx, default_table(), default_book());
+    int score = search_score(&ctx, state, weak, guess);
+    g_nodes_searched += ctx.nodes;
+    g_researches += ctx.researches;
+    return score;
+}
+
+int solve_in_context(SearchContext* ctx, const GameState* state, bool weak) {
+    return solve_in_context_with_guess(ctx, state, weak, NO_SCORE_GUESS);
+}
+
+int solve_in_context_with_guess(SearchContext* ctx, const GameState* state, bool weak, int guess) {
+    if (can_win_next(state)) {
+        return weak ? 1 : (WIDTH * HEIGHT + 1 - state->moves) / 2;
+    }
+    return search_score(ctx, state, weak, guess);
+}
+
+int weak_solve_in_context(WeakContext* weak_ctx, const GameState* state) {
+    assert(weak_ctx != NULL && state != NULL);
+    if (can_win_next(state)) {
+        return WEAK_WIN;
+    }
+
+    // The core takes the book, move order and node counter from a search context, which
+    // has no exact table, limits or dynamic ordering here.
+    SearchContext ctx;
+    init_context(&ctx, NULL, weak_ctx->book);
+    memcpy(ctx.column_order, weak_ctx->column_order, sizeof(ctx.column_order));
+    ctx.dynamic_ordering = false;
+
+    // A win needs the score to reach 1, and a draw 0.
+    SearchState search;
+    init_search_state(&search, state);
+    int outcome = weak_negamax(&ctx, weak_ctx->table, &search, 0, 1) >= 1 ? WEAK_WIN
+                : weak_negamax(&ctx, weak_ctx->table, &search, -1, 0) >= 0 ? WEAK_DRAW
+                : WEAK_LOSS;
+    weak_ctx->nodes += ctx.nodes;
+    return outcome;
+}
+
+// Finds the best move, looking it up in the book if possible and otherwise searching
+// the root moves with the given context, or with the default ones if it is NULL.
+// If scores is not NULL, it receives the exact score of every move.
+static int best_move(SearchContext* ctx, const Book* book, const GameState* state, int scores[WIDTH]) {
     // Check the opening book for a move in the early game.
-    if (state->moves < MAX_BOOK_DEPTH) {
+    if (book && state->moves < book->depth) {
         #ifdef DEBUG
         fprintf(stderr, "DEBUG: Checking book for state with %d moves. Key components (Mask/Pos): %llu / %llu\n", 
                state->moves, state->mask, state->current_position);
         #endif
         int book_move = -1;
-        uint128_t key = book_compute_key(state);
-        if (book_get_move(key, &book_move)) {
+        if (scores) {
+            if (book_lookup_move_scores(book, state, scores)) {
+                // Use the book only if it scores every playable move.
+                for (int col = 0; col < WIDTH; col++) {
+                    if (can_play(state, col) && scores[col] == BOOK_NO_SCORE) {
+                        book_move = -1;
+                        break;
+                    }
+                    if (can_play(state, col) && (book_move < 0 || scores[col] > scores[book_move])) {
+                        book_move = col;
+                    }
+                }
+                if (book_move >= 0) return book_move;
+            }
+        } else if (book_lookup_position(book, state, &book_move)) {
             assert(can_play(state, book_move));
             return book_move;
         }
     }
 
-    int best_move = -1;
-    int best_score = INT_MIN;
-    
-    // Iterate through all valid moves to find the one with the best score.
-    for (int col = 0; col < WIDTH; ++col) {
-        uint64_t move = possible(state) & column_mask(col);
-        if (move) {
-            // An immediate win is always the best possible move.
-            if (is_winning_move(state, col)) return col;
+    if (ctx) {
+        return search_root(ctx, state, scores);
+    }
+    if (g_search_threads > 1) {
+        SearchWorker workers[MAX_SEARCH_THREADS];
+        return search_parallel(workers, state, false, NO_SCORE_GUESS, true, scores)->move;
+    }
 
-            GameState next_state = *state;
-            play_move(&next_state, col);
+    SearchContext default_ctx;
+    init_search_context(&default_ctx, default_table(), book);
+    int move = search_root(&default_ctx, state, scores);
+    g_nodes_searched += default_ctx.nodes;
+    g_researches += default_ctx.researches;
+    return move;
+}
 
-            // The score of our move is the negative of the opponent's score after our move.
-            int score = -solve(&next_state, false);
+int find_best_move(const GameState* state) {
+    return best_move(NULL, default_book(), state, NULL);
+}
 
-            // If this move is better than any found so far, update the best move.
-            if (score > best_score) {
-                best_score = score;
-                best_move = col;
-            }
+int find_best_move_in_context(SearchContext* ctx, const GameState* state) {
+    return best_move(ctx, ctx->book, state, NULL);
+}
+
+int score_moves(const GameState* state, int scores[WIDTH]) {
+    return best_move(NULL, default_book(), state, scores);
+}
+
+int score_moves_in_context(SearchContext* ctx, const GameState* state, int scores[WIDTH]) {
+    return best_move(ctx, ctx->book, state, scores);
+}
+
+// Evaluates a position at the horizon of the heuristic search by the threats each
+// player has: the empty cells that would complete four, as counted by move_score().
+static inline int evaluate_threats(const SearchState* S) {
+    uint64_t empty = BOARD_MASK ^ S->pos.mask;
+    return __builtin_popcountll(S->threats & empty) - __builtin_popcountll(S->opponent_threats & empty);
+}
+
+// Searches the position in S to the given depth with a heuristic evaluation at the
+// horizon. Wins and losses found within the horizon score beyond HEURISTIC_WIN, the
+// sooner the better. No table is used: its entries only hold exact scores. Returns
+// early, with a meaningless value, once the context's limits stop it.
+static int heuristic_negamax(SearchContext* ctx, SearchState* S, int depth, int alpha, int beta) {
+    const GameState* P = &S->pos;
+    if (search_stopped(ctx)) {
+        return 0;
+    }
+    ctx->nodes++;
+    if (ctx->nodes >= ctx->next_check) check_limits(ctx);
+
+    if (is_draw(P)) {
+        return 0;
+    }
+    uint64_t possible = search_state_non_losing_moves(S);
+    if (possible == 0) {
+        return -HEURISTIC_WIN - (WIDTH * HEIGHT - P->moves) / 2;
+    }
+    if (depth == 0) {
+        return evaluate_threats(S);
+    }
+
+    // Order the moves by threat count, as negamax does.
+    uint64_t moves[WIDTH];
+    int count = 0;
+    for (int i = WIDTH; i-- > 0; ) {
+        uint64_t move = possible & column_mask(ctx->column_order[i]);
+        if (move) moves[count++] = move;
+    }
+    uint64_t move_threats[WIDTH];
+    int threat_counts[WIDTH];
+    score_moves_batch(S, moves, count, move_threats, threat_counts);
+    MoveSorter sorter;
+    sorter_init(&sorter);
+    uint64_t child_threats[WIDTH];
+    for (int j = 0; j < count; j++) {
+        child_threats[bitboard_to_col(moves[j])] = move_threats[j];
+        sorter_add(&sorter, moves[j], threat_counts[j]);
+    }
+
+    const uint64_t threats = S->threats;
+    int best = -2 * HEURISTIC_WIN;
+    uint64_t next_move;
+    while ((next_move = sorter_get_next(&sorter))) {
+        search_state_play(S, next_move, child_threats[bitboard_to_col(next_move)]);
+        int score = -heuristic_negamax(ctx, S, depth - 1, -beta, -alpha);
+        search_state_undo(S, next_move, threats);
+        if (search_stopped(ctx)) {
+            return 0;
+        }
+        if (score > best) {
+            best = score;
+            if (score > alpha) alpha = score;
+            if (alpha >= beta) break;
         }
     }
+    return best;
+}
+
+// Searches every root move to the given depth, trying the given move first, and
+// returns the best, or -1 if the search was stopped. The position must have no
+// immediate win and at least one non-losing move. Stores the move's value in value.
+static int heuristic_root(SearchContext* ctx, const GameState* state, int depth, int first_move, int* value) {
+    MoveSorter sorter;
+    sorter_init(&sorter);
+    uint64_t non_losing = possible_non_losing_moves(state);
+    for (int i = WIDTH; i-- > 0; ) {
+        uint64_t move = non_losing & column_mask(ctx->column_order[i]);
+        if (move) {
+            sorter_add(&sorter, move, bitboard_to_col(move) == first_move ? HASH_MOVE_SCORE : move_score(state, move));
+        }
+    }
+
+    SearchState search;
+    init_search_state(&search, state);
+    int best_move = -1;
+    int best = -2 * HEURISTIC_WIN;
+    uint64_t next_move;
+    while ((next_move = sorter_get_next(&sorter))) {
+        const uint64_t threats = search.threats;
+        search_state_play(&search, next_move, threats_after_move(&search, next_move));
+        int score = -heuristic_negamax(ctx, &search, depth - 1, -2 * HEURISTIC_WIN, -best);
+        search_state_undo(&search, next_move, threats);
+        if (search_stopped(ctx)) {
+            return -1;
+        }
+        if (score > best) {
+            best = score;
+            best_move = bitboard_to_col(next_move);
+        }
+    }
+    *value = best;
     return best_move;
-}
\ No newline at end of file
+}
+
+// Deepens the heuristic search one ply at a time until the context's limits stop it,
+// the horizon reaches the end of the game, or a win or loss is found. Returns the move
+// of the deepest completed search, or the move with the most threats if none completed.
+static int heuristic_search(SearchContext* ctx, const GameState* state, int* depth_reached) {
+    // Before any search completes, play the non-losing move creating the most threats.
+    int move = -1;
+    int most_threats = -1;
+    uint64_t non_losing = possible_non_losing_moves(state);
+    for (int i = 0; i < WIDTH; i++) {
+        uint64_t candidate = non_losing & column_mask(ctx->column_order[i]);
+        if (candidate && move_score(state, candidate) > most_threats) {
+            move = ctx->column_order[i];
+            most_threats = move_score(state, candidate);
+        }
+    }
+
+    *depth_reached = 0;
+    for (int depth = 1; depth <= WIDTH * HEIGHT - state->moves; depth++) {
+        int value;
+        int found = heuristic_root(ctx, state, depth, move, &value);
+        if (found < 0) break;
+        move = found;
+        *depth_reached = depth;
+        if (value >= HEURISTIC_WIN || value <= -HEURISTIC_WIN) break;
+    }
+    return move;
+}
+
+int find_best_move_within_context(SearchContext* ctx, const GameState* state, const SearchLimits* limits,
+                                  AnytimeResult* result) {
+    long long start = now_us();
+    uint64_t start_nodes = ctx->nodes;
+    result->move = -1;
+    result->exact = false;
+    result->depth = 0;
+
+    // Immediate wins, positions without any non-losing move and book moves need no budget.
+    int book_move;
+    bool limited = limits->time_us > 0 || limits->nodes > 0;
+    bool trivial = can_win_next(state) || possible_non_losing_moves(state) == 0 ||
+                   (ctx->book && state->moves < ctx->book->depth && book_lookup_position(ctx->book, state, &book_move));
+    if (!limited || trivial || possible(state) == 0) {
+        result->move = best_move(ctx, ctx->book, state, NULL);
+        result->exact = true;
+        result->nodes = ctx->nodes - start_nodes;
+        return result->move;
+    }
+
+    bool* stop = ctx->stop;
+    bool stopped = false;
+    ctx->stop = &stopped;
+    long long deadline = limits->time_us > 0 ? start + limits->time_us : 0;
+    uint64_t node_limit = limits->nodes > 0 ? start_nodes + limits->nodes : UINT64_MAX;
+
+    // A heuristic search with part of the budget provides a move to fall back on.
+    set_limits(ctx, deadline ? start + limits->time_us / HEURISTIC_BUDGET_DIVISOR : 0,
+               limits->nodes > 0 ? start_nodes + limits->nodes / HEURISTIC_BUDGET_DIVISOR + 1 : UINT64_MAX);
+    result->move = heuristic_search(ctx, state, &result->depth);
+
+    // The exact search may use whatever is left of the budget.
+    stopped = false;
+    set_limits(ctx, deadline, node_limit);
+    int move = best_move(ctx, ctx->book, state, NULL);
+    if (!stopped) {
+        result->move = move;
+        result->exact = true;
+    }
+
+    clear_limits(ctx);
+    ctx->stop = stop;
+    result->nodes = ctx->nodes - start_nodes;
+    return result->move;
+}
+
+int find_best_move_within(const GameState* state, const SearchLimits* limits, AnytimeResult* result) {
+    SearchContext ctx;
+    init_search_context(&ctx, default_table(), default_book());
+    int move = find_best_move_within_context(&ctx, state, limits, result);
+    g_nodes_searched += ctx.nodes;
+    g_researches += ctx.researches;
+    return move;
+}
@@ -1,12 +1,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "engine.h"
 #include "bitboard.h"
 #include "table.h"
 #include "player.h"
 #include "interface.h"
+#include "util.h"
 
 // Parses a command-line argument to determine the player type.
 PlayerType parse_player_type(const char* arg) {
@@ -15,18 +17,55 @@ PlayerType parse_player_type(const char* arg) {
 }
 
 int main(int argc, char *argv[]) {
+    // Handle the options given before the player types.
+    int hash_mb = DEFAULT_TABLE_MB;
+    SearchLimits limits = { 0, 0 };
+    int first_player_arg = 1;
+    while (first_player_arg + 1 < argc && strncmp(argv[first_player_arg], "--", 2) == 0) {
+        const char* option = argv[first_player_arg];
+        const char* value = argv[first_player_arg + 1];
+        // Times are given in milliseconds and must not overflow once converted to microseconds.
+        long long max = strcmp(option, "--hash") == 0 ? MAX_INT_OPTION
+                      : strcmp(option, "--time") == 0 ? LLONG_MAX / 1000
+                      : strcmp(option, "--nodes") == 0 ? LLONG_MAX : 0;
+        if (max == 0) {
+            fprintf(stderr, "Error: Unknown option '%s'.\n", option);
+            return 1;
+        }
+        long long number;
+        if (!parse_int_option(value, 1, max, &number)) {
+            fprintf(stderr, "Error: Invalid value '%s' for %s, expected a number from 1 to %lld.\n",
+                    value, option, max);
+            return 1;
+        }
+        if (strcmp(option, "--hash") == 0) {
+            hash_mb = (int)number;
+        } else if (strcmp(option, "--time") == 0) {
+            limits.time_us = number * 1000; // Given in milliseconds.
+        } else {
+            limits.nodes = (uint64_t)number;
+        }
+        first_player_arg += 2;
+    }
+
     // Handle command-line arguments for player types.
-    if (argc != 3 && argc != 1) {
-        fprintf(stderr, "Usage: %s [human|ai] [human|ai]\n", argv[0]);
+    int player_args = argc - first_player_arg;
+    if (player_args != 2 && player_args != 0) {
+        fprintf(stderr, "Usage: %s [--hash <MB>] [--time <ms>] [--nodes <n>] [human|ai] [human|ai]\n", argv[0]);
         fprintf(stderr, "Defaulting to: human ai\n");
     }
 
     init_solver();
-    init_table();
+    // Fault the table in up front, so that the first moves do not spend their budget on it.
+    if (limits.time_us || limits.nodes) set_table_prefault(true);
+    init_table((size_t)hash_mb);
 
     // Setup players based on arguments or defaults.
-    Player p1 = { .type = (argc == 3) ? parse_player_type(argv[1]) : PLAYER_TYPE_HUMAN, .symbol = 'O' };
-    Player p2 = { .type = (argc == 3) ? parse_player_type(argv[2]) : PLAYER_TYPE_AI, .symbol = 'X' };
+    bool has_players = player_args == 2;
+    Player p1 = { .type = has_players ? parse_player_type(argv[first_player_arg]) : PLAYER_TYPE_HUMAN, .symbol = 'O',
+                  .limits = limits };
+    Player p2 = { .type = has_players ? parse_player_type(argv[first_player_arg + 1]) : PLAYER_TYPE_AI, .symbol = 'X',
+                  .limits = limits };
     Player* current_player = &p1;
 
     GameState game;
@@ -37,6 +76,8 @@ int main(int argc, char *argv[]) {
         draw_board(&game, &p1, &p2);
         printf("Player %c's turn (%s).\n", current_player->symbol, current_player->type == PLAYER_TYPE_AI ? "AI" : "Human");
 
+        // Entries from earlier moves stay usable, but give way to the new search first.
+        age_table();
         int move = get_player_move(current_player, &game);
         if (move < 0) {
             printf("Player %c has no moves and forfeits.\n", current_player->symbol);
@@ -1,6 +1,7 @@
 #include "ordering.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Initializes a move sorter.
 void sorter_init(MoveSorter* sorter) {
@@ -30,4 +31,39 @@ uint64_t sorter_get_next(MoveSorter* sorter) {
         return sorter->entries[--sorter->size].move;
     }
     return 0; // Indicates no moves are left.
-}
\ No newline at end of file
+}
+
+// History weights are halved once one exceeds this, so they never reach the rank weights.
+#define MAX_HISTORY ((1u << 18) - 1)
+
+// Forgets all killer moves and history.
+void history_reset(OrderingHistory* history) {
+    assert(history != NULL);
+    memset(history->killers, -1, sizeof(history->killers));
+    memset(history->history, 0, sizeof(history->history));
+}
+
+// Remembers a cutoff move as the ply's latest killer and adds to its cell's history.
+// Cutoffs nearer the root, with larger subtrees, weigh more.
+void history_record_cutoff(OrderingHistory* history, int ply, uint64_t move) {
+    assert(history != NULL);
+    assert(ply >= 0 && ply < MAX_PLY);
+    assert(move != 0 && (move & (move - 1)) == 0);
+    int col = bitboard_to_col(move);
+    if (history->killers[ply][0] != col) {
+        history->killers[ply][1] = history->killers[ply][0];
+        history->killers[ply][0] = (int8_t)col;
+    }
+
+    int depth = WIDTH * HEIGHT - ply;
+    uint32_t* weight = &history->history[ply & 1][__builtin_ctzll(move)];
+    *weight += (uint32_t)(depth * depth);
+    if (*weight > MAX_HISTORY) {
+        // Age every weight, keeping their order, so that recent cutoffs count more.
+        for (int player = 0; player < 2; player++) {
+            for (int cell = 0; cell < WIDTH * PHEIGHT; cell++) {
+                history->history[player][cell] >>= 1;
+            }
+        }
+    }
+}
@@ -25,9 +25,18 @@ static int get_human_move(const GameState* game) {
 // Gets a move for the specified player (human or AI).
 int get_player_move(const Player* player, const GameState* game) {
     switch (player->type) {
-        case PLAYER_TYPE_AI:
+        case PLAYER_TYPE_AI: {
             printf("AI is thinking...\n");
-            return find_best_move(game);
+            if (player->limits.time_us == 0 && player->limits.nodes == 0) {
+                return find_best_move(game);
+            }
+            AnytimeResult result;
+            int move = find_best_move_within(game, &player->limits, &result);
+            if (!result.exact) {
+                printf("AI ran out of time; its move comes from a %d-ply heuristic search.\n", result.depth);
+            }
+            return move;
+        }
         case PLAYER_TYPE_HUMAN:
         default:
             return get_human_move(game);
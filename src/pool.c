@@ -0,0 +1,156 @@
+#include "pool.h"
+#include "engine.h"
+#include "table.h"
+#include "weak.h"
+#include "dfpn.h"
+#include "book.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+// Maximum number of worker threads in a pool.
+#define MAX_POOL_WORKERS 256
+
+// State shared between the workers and the thread collecting results.
+typedef struct {
+    SolveJob* jobs;
+    size_t count;
+    size_t table_mb;
+    SolveMode mode;
+    size_t next_job;      // Index of the next job to hand out, taken atomically
+    bool* done;           // done[i] is set once jobs[i] has been solved
+    pthread_mutex_t lock; // Protects done
+    pthread_cond_t job_done;
+} JobQueue;
+
+// Worker loop: solves jobs with a private table until none are left. Weak solves use
+// their solver's own table format. Every worker consults the default book, which is
+// shared read-only, as a sequential solve does.
+static void* pool_worker_main(void* arg) {
+    JobQueue* queue = (JobQueue*)arg;
+
+    TransTable table;
+    SearchContext ctx;
+    WeakTable weak_table;
+    WeakContext weak_ctx;
+    DfpnTable dfpn_table;
+    DfpnContext dfpn_ctx;
+    switch (queue->mode) {
+    case SOLVE_EXACT:
+        table_init(&table, queue->table_mb);
+        init_search_context(&ctx, &table, default_book());
+        break;
+    case SOLVE_WEAK:
+        weak_table_init(&weak_table, queue->table_mb);
+        init_weak_context(&weak_ctx, &weak_table, default_book());
+        break;
+    case SOLVE_DFPN:
+        dfpn_table_init(&dfpn_table, queue->table_mb);
+        init_dfpn_context(&dfpn_ctx, &dfpn_table, default_book());
+        break;
+    }
+
+    size_t i;
+    while ((i = __atomic_fetch_add(&queue->next_job, 1, __ATOMIC_RELAXED)) < queue->count) {
+        SolveJob* job = &queue->jobs[i];
+
+        // Start from an empty table and history so node counts match a standalone solve.
+        switch (queue->mode) {
+        case SOLVE_EXACT:
+            table_reset(&table);
+            history_reset(&ctx.ordering);
+            ctx.nodes = 0;
+            break;
+        case SOLVE_WEAK:
+            weak_table_reset(&weak_table);
+            weak_ctx.nodes = 0;
+            break;
+        case SOLVE_DFPN:
+            dfpn_table_reset(&dfpn_table);
+            dfpn_ctx.nodes = 0;
+            break;
+        }
+
+        long long start = now_us();
+        switch (queue->mode) {
+        case SOLVE_EXACT:
+            job->score = solve_in_context(&ctx, &job->state, false);
+            job->nodes = ctx.nodes;
+            break;
+        case SOLVE_WEAK:
+            job->score = weak_solve_in_context(&weak_ctx, &job->state);
+            job->nodes = weak_ctx.nodes;
+            break;
+        case SOLVE_DFPN:
+            job->score = dfpn_solve_in_context(&dfpn_ctx, &job->state);
+            job->nodes = dfpn_ctx.nodes;
+            break;
+        }
+        job->time_us = now_us() - start;
+
+        pthread_mutex_lock(&queue->lock);
+        queue->done[i] = true;
+        pthread_cond_broadcast(&queue->job_done);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    switch (queue->mode) {
+    case SOLVE_EXACT: table_free(&table); break;
+    case SOLVE_WEAK: weak_table_free(&weak_table); break;
+    case SOLVE_DFPN: dfpn_table_free(&dfpn_table); break;
+    }
+    return NULL;
+}
+
+void solve_jobs(SolveJob* jobs, size_t count, int num_workers, size_t table_mb, SolveMode mode,
+                SolveJobCallback on_done, void* user_data) {
+    assert(jobs != NULL || count == 0);
+    if (count == 0) return;
+
+    if (num_workers < 1) num_workers = 1;
+    if (num_workers > MAX_POOL_WORKERS) num_workers = MAX_POOL_WORKERS;
+    if ((size_t)num_workers > count) num_workers = (int)count;
+
+    JobQueue queue = { .jobs = jobs, .count = count, .table_mb = table_mb, .mode = mode, .next_job = 0 };
+    queue.done = (bool*)calloc(count, sizeof(bool));
+    if (!queue.done) {
+        fprintf(stderr, "Error: Failed to allocate memory for the job queue.\n");
+        abort();
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.job_done, NULL);
+
+    pthread_t workers[MAX_POOL_WORKERS];
+    int started = 0;
+    for (; started < num_workers; started++) {
+        if (pthread_create(&workers[started], NULL, pool_worker_main, &queue) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        // No thread could be started, so solve everything on the calling thread.
+        pool_worker_main(&queue);
+    } else if (started < num_workers) {
+        fprintf(stderr, "Warning: Could only start %d pool workers.\n", started);
+    }
+
+    // Report results in input order as soon as each prefix of the jobs is complete.
+    for (size_t i = 0; i < count; i++) {
+        pthread_mutex_lock(&queue.lock);
+        while (!queue.done[i]) {
+            pthread_cond_wait(&queue.job_done, &queue.lock);
+        }
+        pthread_mutex_unlock(&queue.lock);
+        if (on_done) on_done(&jobs[i], i, user_data);
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_cond_destroy(&queue.job_done);
+    pthread_mutex_destroy(&queue.lock);
+    free(queue.done);
+}
@@ -0,0 +1,557 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "engine.h"
+#include "bitboard.h"
+#include "table.h"
+#include "book.h"
+#include "util.h"
+
+// Maximum accepted length of a request line.
+#define MAX_LINE_LENGTH 256
+// Maximum length of a request id.
+#define MAX_ID_LENGTH 64
+// Maximum length of the result of a request: a move and the score of every column.
+#define MAX_RESULT_LENGTH 64
+// Maximum length of a reply line.
+#define MAX_REPLY_LENGTH 512
+// Maximum number of connections served at once.
+#define MAX_CLIENTS 256
+// Maximum number of worker threads.
+#define MAX_WORKERS 256
+// Size of the reads from a connection.
+#define READ_CHUNK 4096
+
+// A connection requests are read from and replies are written to. A client is freed once
+// it is closed and every request read from it has been answered.
+typedef struct {
+    int in_fd;
+    int out_fd;
+    char line[MAX_LINE_LENGTH]; // The request line read so far
+    size_t length;
+    bool overlong;              // The current line is too long and is being skipped
+    int refs;                   // One for the open connection, plus one per unanswered request
+    bool failed;                // A reply could not be written, so later ones are dropped
+    pthread_mutex_t write_lock; // Keeps the replies of different workers whole
+} Client;
+
+// What a request asks for.
+typedef enum {
+    REQUEST_SOLVE,  // The exact score
+    REQUEST_WEAK,   // Whether the position is won, drawn or lost
+    REQUEST_BEST,   // The best move
+    REQUEST_SCORES, // The best move and the score of every column
+} RequestType;
+
+// A parsed request waiting for a worker.
+typedef struct Request {
+    struct Request* next;
+    Client* client;
+    RequestType type;
+    char id[MAX_ID_LENGTH + 1];
+    GameState state;
+    long long received_us; // When the request line was read
+} Request;
+
+// A worker thread and the flag that abandons its current search.
+typedef struct {
+    pthread_t thread;
+    bool stop; // Set when the request's time is up or the server is stopped
+} Worker;
+
+// Requests in arrival order, shared by the reading thread and the workers.
+typedef struct {
+    Request* head;
+    Request* tail;
+    bool closed; // No more requests will be added
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+} RequestQueue;
+
+static RequestQueue g_queue = { .lock = PTHREAD_MUTEX_INITIALIZER, .available = PTHREAD_COND_INITIALIZER };
+
+// Protects the reference counts of all clients.
+static pthread_mutex_t g_clients_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Set by SIGINT and SIGTERM to shut the server down.
+static volatile sig_atomic_t g_stop = 0;
+
+// Set once the server is stopped, after which the workers answer every request with an error.
+static bool g_shutting_down = false;
+
+// Search time allowed for each request in microseconds, or 0 for no limit.
+static long long g_request_time_us = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+// Allocates a client with one reference, held by its open connection.
+static Client* new_client(int in_fd, int out_fd) {
+    Client* client = (Client*)calloc(1, sizeof(Client));
+    if (!client) {
+        fprintf(stderr, "Error: Failed to allocate memory for a connection.\n");
+        abort();
+    }
+    client->in_fd = in_fd;
+    client->out_fd = out_fd;
+    client->refs = 1;
+    pthread_mutex_init(&client->write_lock, NULL);
+    return client;
+}
+
+static void retain_client(Client* client) {
+    pthread_mutex_lock(&g_clients_lock);
+    client->refs++;
+    pthread_mutex_unlock(&g_clients_lock);
+}
+
+// Drops a reference, closing the connection and freeing the client with the last one.
+// The standard streams are left open.
+static void release_client(Client* client) {
+    pthread_mutex_lock(&g_clients_lock);
+    bool last = --client->refs == 0;
+    pthread_mutex_unlock(&g_clients_lock);
+    if (!last) return;
+
+    if (client->in_fd > STDERR_FILENO) close(client->in_fd);
+    if (client->out_fd > STDERR_FILENO && client->out_fd != client->in_fd) close(client->out_fd);
+    pthread_mutex_destroy(&client->write_lock);
+    free(client);
+}
+
+// Writes a whole reply line to a client. A client that cannot be written to, such as one
+// that disconnected, gets no further replies.
+static void send_reply(Client* client, const char* reply) {
+    pthread_mutex_lock(&client->write_lock);
+    size_t length = strlen(reply);
+    size_t written = 0;
+    while (!client->failed && written < length) {
+        ssize_t n = write(client->out_fd, reply + written, length - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            client->failed = true;
+            break;
+        }
+        written += (size_t)n;
+    }
+    pthread_mutex_unlock(&client->write_lock);
+}
+
+// Replies to a request with an error message.
+static void send_error(Client* client, const char* id, const char* message) {
+    char reply[MAX_REPLY_LENGTH];
+    snprintf(reply, sizeof(reply), "%s error %s\n", id, message);
+    send_reply(client, reply);
+}
+
+static void queue_push(Request* request) {
+    pthread_mutex_lock(&g_queue.lock);
+    request->next = NULL;
+    if (g_queue.tail) {
+        g_queue.tail->next = request;
+    } else {
+        g_queue.head = request;
+    }
+    g_queue.tail = request;
+    pthread_cond_signal(&g_queue.available);
+    pthread_mutex_unlock(&g_queue.lock);
+}
+
+// Takes the oldest request, waiting for one. Returns NULL once the queue is closed and empty.
+static Request* queue_pop(void) {
+    pthread_mutex_lock(&g_queue.lock);
+    while (!g_queue.head && !g_queue.closed) {
+        pthread_cond_wait(&g_queue.available, &g_queue.lock);
+    }
+    Request* request = g_queue.head;
+    if (request) {
+        g_queue.head = request->next;
+        if (!g_queue.head) g_queue.tail = NULL;
+    }
+    pthread_mutex_unlock(&g_queue.lock);
+    return request;
+}
+
+// Lets the workers answer the queued requests and exit.
+static void queue_close(void) {
+    pthread_mutex_lock(&g_queue.lock);
+    g_queue.closed = true;
+    pthread_cond_broadcast(&g_queue.available);
+    pthread_mutex_unlock(&g_queue.lock);
+}
+
+// Returns the request type named by a command, or -1 if it is unknown.
+static int parse_command(const char* command) {
+    if (strcmp(command, "solve") == 0) return REQUEST_SOLVE;
+    if (strcmp(command, "weak") == 0) return REQUEST_WEAK;
+    if (strcmp(command, "best") == 0) return REQUEST_BEST;
+    if (strcmp(command, "scores") == 0) return REQUEST_SCORES;
+    return -1;
+}
+
+// Parses a request line of the form "<id> <command> [<moves>]" and queues it, or replies
+// with an error right away. Blank lines and lines starting with '#' are ignored.
+static void handle_line(Client* client, char* line, long long received_us) {
+    char* save = NULL;
+    char* id = strtok_r(line, " \t\r", &save);
+    if (!id || id[0] == '#') return;
+    char* command = strtok_r(NULL, " \t\r", &save);
+    char* moves = strtok_r(NULL, " \t\r", &save);
+    char* extra = strtok_r(NULL, " \t\r", &save);
+
+    if (strlen(id) > MAX_ID_LENGTH) {
+        send_error(client, "-", "Request id is too long.");
+        return;
+    }
+    int type = command ? parse_command(command) : -1;
+    if (type < 0) {
+        send_error(client, id, "Unknown command, expected solve, weak, best or scores.");
+        return;
+    }
+    if (extra) {
+        send_error(client, id, "Too many fields.");
+        return;
+    }
+
+    Request* request = (Request*)malloc(sizeof(Request));
+    if (!request) {
+        fprintf(stderr, "Error: Failed to allocate memory for a request.\n");
+        abort();
+    }
+    char message[MAX_REPLY_LENGTH];
+    if (parse_moves(&request->state, moves ? moves : "", message, sizeof(message))) {
+        send_error(client, id, message);
+        free(request);
+        return;
+    }
+    request->client = client;
+    request->type = (RequestType)type;
+    strcpy(request->id, id);
+    request->received_us = received_us;
+    retain_client(client);
+    queue_push(request);
+}
+
+// Splits the bytes read from a client into request lines.
+static void handle_input(Client* client, const char* data, size_t size, long long received_us) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            if (client->overlong) {
+                send_error(client, "-", "Request line is too long.");
+            } else {
+                client->line[client->length] = '\0';
+                handle_line(client, client->line, received_us);
+            }
+            client->length = 0;
+            client->overlong = false;
+        } else if (client->length < MAX_LINE_LENGTH - 1) {
+            client->line[client->length++] = data[i];
+        } else {
+            client->overlong = true;
+        }
+    }
+}
+
+// Reads what a client has sent. Returns false once the client has closed its end, after
+// handling a last line without a newline.
+static bool read_client(Client* client) {
+    char data[READ_CHUNK];
+    ssize_t n = read(client->in_fd, data, sizeof(data));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return true;
+    if (n > 0) {
+        handle_input(client, data, (size_t)n, now_us());
+        return true;
+    }
+    if (client->length > 0) {
+        handle_input(client, "\n", 1, now_us());
+    }
+    return false;
+}
+
+// Worker loop: answers queued requests with a private search context on the shared table
+// until the queue is closed. Replies are
+//   <id> <result> <nodes> <search_us> <latency_us>
+// where the latency runs from reading the request to replying, queueing included.
+static void* worker_main(void* arg) {
+    Worker* worker = (Worker*)arg;
+    SearchContext ctx;
+    init_search_context(&ctx, default_table(), default_book());
+    ctx.stop = &worker->stop;
+    SearchLimits limits = { g_request_time_us, 0 };
+
+    Request* request;
+    while ((request = queue_pop()) != NULL) {
+        // Cleared before checking for a shutdown, so that a shutdown after the check
+        // still stops the search.
+        __atomic_store_n(&worker->stop, false, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&g_shutting_down, __ATOMIC_SEQ_CST)) {
+            send_error(request->client, request->id, "Server is shutting down.");
+            release_client(request->client);
+            free(request);
+            continue;
+        }
+        ctx.nodes = 0;
+        history_reset(&ctx.ordering);
+        set_search_limits(&ctx, &limits);
+
+        char result[MAX_RESULT_LENGTH];
+        int move = 0;
+        long long start = now_us();
+        switch (request->type) {
+        case REQUEST_SOLVE:
+            snprintf(result, sizeof(result), "%d", solve_in_context(&ctx, &request->state, false));
+            break;
+        case REQUEST_WEAK:
+            snprintf(result, sizeof(result), "%d", solve_in_context(&ctx, &request->state, true));
+            break;
+        case REQUEST_BEST:
+        case REQUEST_SCORES: {
+            int scores[WIDTH];
+            move = request->type == REQUEST_SCORES
+                ? score_moves_in_context(&ctx, &request->state, scores)
+                : find_best_move_in_context(&ctx, &request->state);
+            if (move < 0) break;
+            int length = snprintf(result, sizeof(result), "%d", move + 1);
+            for (int col = 0; request->type == REQUEST_SCORES && col < WIDTH; col++) {
+                if (scores[col] == INVALID_MOVE_SCORE) {
+                    length += snprintf(result + length, sizeof(result) - length, " -");
+                } else {
+                    length += snprintf(result + length, sizeof(result) - length, " %d", scores[col]);
+                }
+            }
+            break;
+        }
+        }
+        long long end = now_us();
+
+        // A stopped search has no result.
+        if (__atomic_load_n(&worker->stop, __ATOMIC_SEQ_CST)) {
+            send_error(request->client, request->id,
+                       __atomic_load_n(&g_shutting_down, __ATOMIC_SEQ_CST) ? "Server is shutting down."
+                                                                           : "Time limit exceeded.");
+        } else if (move < 0) {
+            send_error(request->client, request->id, "No move is possible.");
+        } else {
+            char reply[MAX_REPLY_LENGTH];
+            snprintf(reply, sizeof(reply), "%s %s %llu %lld %lld\n", request->id, result,
+                     (unsigned long long)ctx.nodes, end - start, end - request->received_us);
+            send_reply(request->client, reply);
+        }
+        release_client(request->client);
+        free(request);
+    }
+    return NULL;
+}
+
+// Creates a listening Unix domain socket, replacing a stale socket file at the path.
+// Returns the socket, or -1 on error.
+static int listen_on(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long.\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: Could not listen on '%s': %s.\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads requests from standard input, or from the connections to a listening socket, until
+// the input ends or the server is stopped.
+static void serve(int listen_fd) {
+    struct pollfd fds[MAX_CLIENTS + 1];
+    Client* clients[MAX_CLIENTS + 1];
+    int count = 0;
+
+    if (listen_fd >= 0) {
+        fds[count] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        clients[count++] = NULL;
+    } else {
+        fds[count] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+        clients[count++] = new_client(STDIN_FILENO, STDOUT_FILENO);
+    }
+
+    while (!g_stop && count > 0) {
+        if (poll(fds, (nfds_t)count, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: poll failed: %s.\n", strerror(errno));
+            break;
+        }
+        for (int i = count - 1; i >= 0; i--) {
+            if (!fds[i].revents) continue;
+            if (!clients[i]) {
+                int fd = accept(listen_fd, NULL, NULL);
+                if (fd < 0) continue;
+                if (count > MAX_CLIENTS) {
+                    fprintf(stderr, "Warning: Refusing a connection beyond %d.\n", MAX_CLIENTS);
+                    close(fd);
+                    continue;
+                }
+                fds[count] = (struct pollfd){ .fd = fd, .events = POLLIN };
+                clients[count++] = new_client(fd, fd);
+            } else if (!read_client(clients[i])) {
+                // The connection stays open for replies until its requests are answered.
+                release_client(clients[i]);
+                fds[i] = fds[count - 1];
+                clients[i] = clients[count - 1];
+                count--;
+                if (listen_fd < 0) count = 0; // Standard input has ended.
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (clients[i]) release_client(clients[i]);
+    }
+}
+
+static void print_usage(const char* prog_name) {
+    fprintf(stderr, "Usage: %s [options]\n", prog_name);
+    fprintf(stderr, "Answers requests \"<id> <command> [<moves>]\" with \"<id> <result> <nodes> <search_us> <latency_us>\".\n");
+    fprintf(stderr, "Commands: solve (score), weak (1, 0 or -1), best (column), scores (column and the score of each column)\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --socket <path>  Listen on a Unix domain socket instead of reading standard input\n");
+    fprintf(stderr, "  --workers <n>    Answer n requests at once, sharing one table (default 1)\n");
+    fprintf(stderr, "  --hash <MB>      Size of the transposition table (default %d)\n", DEFAULT_TABLE_MB);
+    fprintf(stderr, "  --load-table <file>  Start from a table snapshot, mapped copy-on-write\n");
+    fprintf(stderr, "  --timeout <ms>   Answer requests whose search takes longer with an error\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char* socket_path = NULL;
+    int workers = 1;
+    int hash_mb = DEFAULT_TABLE_MB;
+    const char* load_table = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = parse_positive_int(argv[++i]);
+            if (!workers || workers > MAX_WORKERS) {
+                fprintf(stderr, "Error: Invalid worker count '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            hash_mb = parse_positive_int(argv[++i]);
+            if (!hash_mb) {
+                fprintf(stderr, "Error: Invalid table size '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--load-table") == 0 && i + 1 < argc) {
+            load_table = argv[++i];
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            long long timeout_ms;
+            if (!parse_int_option(argv[++i], 1, LLONG_MAX / 1000, &timeout_ms)) {
+                fprintf(stderr, "Error: Invalid timeout '%s'.\n", argv[i]);
+                return 1;
+            }
+            g_request_time_us = timeout_ms * 1000;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // A client that disconnects early must not kill the server with SIGPIPE, and a stop
+    // signal must interrupt poll() rather than restart it.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int listen_fd = -1;
+    if (socket_path) {
+        listen_fd = listen_on(socket_path);
+        if (listen_fd < 0) return 1;
+    }
+
+    // The table and book stay resident for the server's lifetime, so every request after
+    // the first finds them warm.
+    set_table_prefault(true);
+    init_solver();
+    if (load_table) {
+        if (!init_table_from_snapshot(load_table, false)) {
+            if (listen_fd >= 0) {
+                close(listen_fd);
+                unlink(socket_path);
+            }
+            return 1;
+        }
+    } else {
+        init_table((size_t)hash_mb);
+    }
+
+    // Stop signals are left to the main thread, whose poll() they must interrupt.
+    sigset_t stop_signals, previous_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous_mask);
+    Worker worker_threads[MAX_WORKERS];
+    int started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&worker_threads[started].thread, NULL, worker_main, &worker_threads[started]) != 0) {
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    if (started == 0) {
+        fprintf(stderr, "Error: Could not start a worker thread.\n");
+        return 1;
+    } else if (started < workers) {
+        fprintf(stderr, "Warning: Could only start %d workers.\n", started);
+    }
+    if (socket_path) {
+        fprintf(stderr, "Info: Listening on '%s' with %d workers.\n", socket_path, started);
+    }
+
+    serve(listen_fd);
+
+    // Once the input ends, everything already read is answered before exiting. A stopped
+    // server abandons the searches in progress and answers the queued requests with an error.
+    if (g_stop) {
+        __atomic_store_n(&g_shutting_down, true, __ATOMIC_SEQ_CST);
+        for (int i = 0; i < started; i++) {
+            __atomic_store_n(&worker_threads[i].stop, true, __ATOMIC_SEQ_CST);
+        }
+    }
+    queue_close();
+    for (int i = 0; i < started; i++) {
+        pthread_join(worker_threads[i].thread, NULL);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    free_table();
+    return 0;
+}
@@ -1,82 +1,475 @@
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
-#include <time.h>
 #include <stdlib.h>
 
 #include "engine.h"
 #include "bitboard.h"
 #include "table.h"
 #include "book.h"
+#include "pool.h"
+#include "weak.h"
+#include "dfpn.h"
+#include "stats.h"
+#include "util.h"
+
+// Maximum accepted length of a line in batch mode.
+#define MAX_LINE_LENGTH 256
+
+// If true, the table is not cleared between positions, so later positions reuse earlier results.
+static bool g_keep_table = false;
+
+// Guess of the score passed to the search, or NO_SCORE_GUESS.
+static int g_guess = NO_SCORE_GUESS;
+// If true, each batch position is guessed to have the previous position's score.
+static bool g_guess_previous = false;
+// If true, the number of null-window re-searches is reported on standard error.
+static bool g_report_researches = false;
+
+// Stream receiving the search statistics of every solve as JSON lines, or NULL.
+static FILE* g_stats_out = NULL;
+
+// How positions are solved. The weak modes only find whether positions are won, drawn or lost.
+static SolveMode g_mode = SOLVE_EXACT;
+// Tables and contexts of the weak solvers, used instead of the default table in their modes.
+static WeakTable g_weak_table;
+static WeakContext g_weak_ctx;
+static DfpnTable g_dfpn_table;
+static DfpnContext g_dfpn_ctx;
+
+// A position read in parallel batch mode, along with its input line.
+typedef struct {
+    char move_string[MAX_LINE_LENGTH];
+    int line_num;
+    int fields;         // 2 if the line holds an expected score, 1 otherwise
+    int expected_score;
+} BatchLine;
+
+// Output state for the parallel batch callback.
+typedef struct {
+    const BatchLine* lines;
+    int status;
+} BatchOutput;
+
+// Plays a move string on an empty board, returning 1 on success, 0 on error.
+static int parse_position(GameState* game, const char* move_string) {
+    char message[MAX_LINE_LENGTH + 64];
+    if (parse_moves(game, move_string, message, sizeof(message))) {
+        fprintf(stderr, "Error: %s\n", message);
+        return 0;
+    }
+    return 1;
+}
 
 // Sets up the board from a move string, returning 1 on success, 0 on error.
 static int setup_board(GameState* game, const char* move_string) {
-    init_gamestate(game);
     reset_solver();
-    reset_table();
-
-    for (size_t i = 0; i < strlen(move_string); ++i) {
-        char move_char = move_string[i];
-        if (!isdigit(move_char) || move_char == '0') {
-            fprintf(stderr, "Error: Invalid char '%c' in position '%s'.\n", move_char, move_string);
-            return 0;
+    stats_reset();
+    if (!g_keep_table) {
+        switch (g_mode) {
+        case SOLVE_EXACT: reset_table(); break;
+        case SOLVE_WEAK: weak_table_reset(&g_weak_table); break;
+        case SOLVE_DFPN: dfpn_table_reset(&g_dfpn_table); break;
         }
-        
-        int col = (move_char - '0') - 1; // Moves are 1-indexed in the string.
-        if (col < 0 || col >= WIDTH) {
-            fprintf(stderr, "Error: Invalid column '%c' in position '%s'.\n", move_char, move_string);
-            return 0;
+    }
+    return parse_position(game, move_string);
+}
+
+// Prints one batch result line and checks it against the expected score, if any.
+// Returns 0 if the score is as expected, 1 otherwise.
+static int report_result(const char* move_string, const GameState* game, int score, uint64_t nodes,
+                         long long time_us, int line_num, int fields, int expected_score) {
+    // Each result line is prefixed with its position so skipped lines cannot misalign the stream.
+    fprintf(stdout, "%s %llu %llu %d %llu %lld\n",
+            move_string,
+            (unsigned long long)game->current_position,
+            (unsigned long long)game->mask,
+            score,
+            (unsigned long long)nodes,
+            time_us);
+    fflush(stdout); // Stream results to a consumer reading through a pipe.
+
+    if (g_mode != SOLVE_EXACT) {
+        expected_score = (expected_score > 0) - (expected_score < 0); // Only the outcome is solved.
+    }
+    if (fields == 2 && score != expected_score) {
+        fprintf(stderr, "Error: Line %d '%s' expected %d, got %d.\n",
+                line_num, move_string, expected_score, score);
+        return 1;
+    }
+    return 0;
+}
+
+// Writes the search statistics of the last solve, if they were requested.
+static void write_stats(const char* move_string) {
+    if (!g_stats_out) return;
+    SearchStats stats = stats_current();
+    stats_write_json(g_stats_out, move_string, &stats);
+    fflush(g_stats_out);
+}
+
+// Closes the statistics stream unless it is stdout.
+static void close_stats(void) {
+    if (g_stats_out && g_stats_out != stdout) fclose(g_stats_out);
+    g_stats_out = NULL;
+}
+
+// Frees the table positions were solved with.
+static void free_tables(void) {
+    switch (g_mode) {
+    case SOLVE_EXACT: free_table(); break;
+    case SOLVE_WEAK: weak_table_free(&g_weak_table); break;
+    case SOLVE_DFPN: dfpn_table_free(&g_dfpn_table); break;
+    }
+}
+
+// Solves a prepared position and returns the score, storing the nodes searched and the
+// wall-clock time taken in microseconds. Wall-clock time is used because CPU time would
+// add up the time of every search thread. Weak solves return the outcome as -1, 0 or 1.
+static int timed_solve(const GameState* game, int guess, uint64_t* nodes, long long* time_us) {
+    long long start = now_us();
+    int score = 0;
+    *nodes = 0;
+    switch (g_mode) {
+    case SOLVE_EXACT:
+        score = solve_with_guess(game, false, guess);
+        *nodes = g_nodes_searched;
+        break;
+    case SOLVE_WEAK:
+        g_weak_ctx.nodes = 0;
+        score = weak_solve_in_context(&g_weak_ctx, game);
+        *nodes = g_weak_ctx.nodes;
+        break;
+    case SOLVE_DFPN:
+        g_dfpn_ctx.nodes = 0;
+        score = dfpn_solve_in_context(&g_dfpn_ctx, game);
+        *nodes = g_dfpn_ctx.nodes;
+        break;
+    }
+    *time_us = now_us() - start;
+    return score;
+}
+
+// Solves every position read from the stream, one result line per position.
+// Each input line holds a move string optionally followed by its expected score.
+// Returns 0 if every position was solved (and matched its expected score), 1 otherwise.
+static int run_batch(FILE* input) {
+    char line[MAX_LINE_LENGTH];
+    int line_num = 0;
+    int status = 0;
+    int guess = g_guess;
+    uint64_t researches = 0;
+
+    while (fgets(line, sizeof(line), input)) {
+        line_num++;
+        if (line[0] == '#') continue; // Comment line.
+
+        char move_string[MAX_LINE_LENGTH];
+        int expected_score;
+        int fields = sscanf(line, "%255s %d", move_string, &expected_score);
+        if (fields < 1) continue; // Blank line.
+
+        GameState game;
+        if (!setup_board(&game, move_string)) {
+            fprintf(stderr, "Error: Skipping line %d.\n", line_num);
+            status = 1;
+            continue;
         }
-        if (!can_play(game, col)) {
-            fprintf(stderr, "Error: Column %d is full for position '%s'.\n", col + 1, move_string);
-            return 0;
+
+        uint64_t nodes;
+        long long time_us;
+        int score = timed_solve(&game, guess, &nodes, &time_us);
+        status |= report_result(move_string, &game, score, nodes, time_us,
+                                line_num, fields, expected_score);
+        write_stats(move_string);
+        researches += g_researches;
+        if (g_guess_previous) guess = score;
+    }
+    if (g_report_researches) {
+        fprintf(stderr, "Info: %llu null-window re-searches.\n", (unsigned long long)researches);
+    }
+    return status;
+}
+
+// Pool callback printing each parallel batch result in input order.
+static void print_job_result(const SolveJob* job, size_t index, void* user_data) {
+    BatchOutput* output = (BatchOutput*)user_data;
+    const BatchLine* line = &output->lines[index];
+    output->status |= report_result(line->move_string, &job->state, job->score, job->nodes, job->time_us,
+                                    line->line_num, line->fields, line->expected_score);
+}
+
+// Reads every position from the stream, then solves them on a pool of worker threads,
+// each with its own transposition table. Results are printed in input order.
+// Returns 0 if every position was solved (and matched its expected score), 1 otherwise.
+static int run_batch_parallel(FILE* input, int jobs, size_t hash_mb) {
+    size_t capacity = 1024, count = 0;
+    BatchLine* lines = (BatchLine*)malloc(capacity * sizeof(BatchLine));
+    SolveJob* solve_jobs_array = (SolveJob*)malloc(capacity * sizeof(SolveJob));
+    if (!lines || !solve_jobs_array) {
+        fprintf(stderr, "Error: Failed to allocate memory for the batch.\n");
+        abort();
+    }
+
+    char buffer[MAX_LINE_LENGTH];
+    int line_num = 0;
+    int status = 0;
+
+    while (fgets(buffer, sizeof(buffer), input)) {
+        line_num++;
+        if (buffer[0] == '#') continue; // Comment line.
+
+        if (count == capacity) {
+            capacity *= 2;
+            lines = (BatchLine*)realloc(lines, capacity * sizeof(BatchLine));
+            solve_jobs_array = (SolveJob*)realloc(solve_jobs_array, capacity * sizeof(SolveJob));
+            if (!lines || !solve_jobs_array) {
+                fprintf(stderr, "Error: Failed to allocate memory for the batch.\n");
+                abort();
+            }
         }
-        // The solver assumes the input position has no win for either player.
-        if (is_winning_move(game, col)) {
-             fprintf(stderr, "Error: Position '%s' contains a winning move, which is not supported.\n", move_string);
-             return 0;
+
+        BatchLine* line = &lines[count];
+        line->fields = sscanf(buffer, "%255s %d", line->move_string, &line->expected_score);
+        if (line->fields < 1) continue; // Blank line.
+        line->line_num = line_num;
+
+        if (!parse_position(&solve_jobs_array[count].state, line->move_string)) {
+            fprintf(stderr, "Error: Skipping line %d.\n", line_num);
+            status = 1;
+            continue;
         }
-        play_move(game, col);
+        count++;
     }
-    return 1;
+
+    BatchOutput output = { .lines = lines, .status = status };
+    solve_jobs(solve_jobs_array, count, jobs, hash_mb, g_mode, print_job_result, &output);
+
+    free(lines);
+    free(solve_jobs_array);
+    return output.status;
+}
+
+static void print_usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <move_string>\n", prog);
+    fprintf(stderr, "       %s [options] --batch [file]   (reads positions from stdin if no file is given)\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --weak          Only find whether positions are won (1), drawn (0) or lost (-1)\n");
+    fprintf(stderr, "  --dfpn          Like --weak, but with depth-first proof-number search\n");
+    fprintf(stderr, "  --threads <n>   Search each position with n threads sharing the table (default 1)\n");
+    fprintf(stderr, "  --jobs <n>      In batch mode, solve n positions at once, each thread with its own table (default 1)\n");
+    fprintf(stderr, "  --hash <MB>     Size of the transposition table, per job with --jobs (default %d)\n", DEFAULT_TABLE_MB);
+    fprintf(stderr, "  --history       Adjust the move order with killer moves and history heuristics\n");
+    fprintf(stderr, "  --driver <name> Narrow down scores by 'bisect' (default) or 'mtdf', and report the re-searches\n");
+    fprintf(stderr, "  --guess <score|prev>  Start MTD(f) from this score, or in batch mode from the previous position's\n");
+    fprintf(stderr, "  --stats <file>  Write search statistics for every position as JSON lines ('-' for stdout,\n");
+    fprintf(stderr, "                  needs a build with STATS=1)\n");
+    fprintf(stderr, "  --keep-table    Keep table entries between batch positions instead of clearing the table\n");
+    fprintf(stderr, "  --load-table <file>  Start from a table snapshot, mapped copy-on-write (implies --keep-table)\n");
+    fprintf(stderr, "  --readonly-table     Map the snapshot given to --load-table read-only\n");
+    fprintf(stderr, "  --save-table <file>  Write a table snapshot after solving (implies --keep-table)\n");
+}
+
+// Parses a score option value, returning false if it is invalid.
+static bool parse_score(const char* arg, int* score) {
+    long long value;
+    if (!parse_int_option(arg, -(WIDTH * HEIGHT), WIDTH * HEIGHT, &value)) return false;
+    *score = (int)value;
+    return true;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <move_string>\n", argv[0]);
+    bool batch = false;
+    const char* positional = NULL; // The move string, or the batch input file.
+    int threads = 1;
+    int jobs = 1;
+    int hash_mb = DEFAULT_TABLE_MB;
+    const char* load_table = NULL;
+    const char* save_table = NULL;
+    bool readonly_table = false;
+    const char* stats_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        } else if (strcmp(argv[i], "--weak") == 0) {
+            g_mode = SOLVE_WEAK;
+        } else if (strcmp(argv[i], "--dfpn") == 0) {
+            g_mode = SOLVE_DFPN;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = parse_positive_int(argv[++i]);
+            if (!threads) {
+                fprintf(stderr, "Error: Invalid thread count '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = parse_positive_int(argv[++i]);
+            if (!jobs) {
+                fprintf(stderr, "Error: Invalid job count '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            hash_mb = parse_positive_int(argv[++i]);
+            if (!hash_mb) {
+                fprintf(stderr, "Error: Invalid table size '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--history") == 0) {
+            set_dynamic_ordering(true);
+        } else if (strcmp(argv[i], "--driver") == 0 && i + 1 < argc) {
+            const char* driver = argv[++i];
+            if (strcmp(driver, "bisect") == 0) {
+                set_search_driver(SEARCH_BISECTION);
+            } else if (strcmp(driver, "mtdf") == 0) {
+                set_search_driver(SEARCH_MTDF);
+            } else {
+                fprintf(stderr, "Error: Unknown search driver '%s'.\n", driver);
+                return 1;
+            }
+            g_report_researches = true;
+        } else if (strcmp(argv[i], "--guess") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "prev") == 0) {
+                g_guess_previous = true;
+            } else if (!parse_score(argv[i], &g_guess)) {
+                fprintf(stderr, "Error: Invalid score guess '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--keep-table") == 0) {
+            g_keep_table = true;
+        } else if (strcmp(argv[i], "--load-table") == 0 && i + 1 < argc) {
+            load_table = argv[++i];
+            g_keep_table = true;
+        } else if (strcmp(argv[i], "--readonly-table") == 0) {
+            readonly_table = true;
+        } else if (strcmp(argv[i], "--save-table") == 0 && i + 1 < argc) {
+            save_table = argv[++i];
+            g_keep_table = true;
+        } else if (!positional) {
+            positional = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!batch && !positional) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (jobs > 1 && (!batch || threads > 1 || g_keep_table)) {
+        fprintf(stderr, "Error: --jobs requires --batch and cannot be combined with --threads or table options.\n");
+        return 1;
+    }
+    if (g_mode != SOLVE_EXACT && (threads > 1 || load_table || save_table || g_report_researches)) {
+        fprintf(stderr, "Error: --weak and --dfpn cannot be combined with --threads, --driver or table snapshots.\n");
+        return 1;
+    }
+    if (stats_path && !stats_enabled()) {
+        fprintf(stderr, "Error: --stats needs a solver built with STATS=1.\n");
+        return 1;
+    }
+    if (stats_path && (g_mode != SOLVE_EXACT || jobs > 1)) {
+        fprintf(stderr, "Error: --stats cannot be combined with --weak, --dfpn or --jobs.\n");
+        return 1;
+    }
+    if (readonly_table && (!load_table || save_table)) {
+        fprintf(stderr, "Error: --readonly-table requires --load-table and cannot be combined with --save-table.\n");
         return 1;
     }
 
+    FILE* input = stdin;
+    if (batch && positional && strcmp(positional, "-") != 0) {
+        input = fopen(positional, "r");
+        if (!input) {
+            fprintf(stderr, "Error: Could not open '%s'.\n", positional);
+            return 1;
+        }
+    }
+
     // Initialize solver modules.
     init_solver();
-    init_table();
     init_book();
 
+    if (jobs > 1) {
+        // Pool workers allocate their own tables, so the default table is not needed.
+        int status = run_batch_parallel(input, jobs, (size_t)hash_mb);
+        if (input != stdin) fclose(input);
+        free_book();
+        return status;
+    }
+
+    if (g_mode == SOLVE_WEAK) {
+        weak_table_init(&g_weak_table, (size_t)hash_mb);
+        init_weak_context(&g_weak_ctx, &g_weak_table, default_book());
+    } else if (g_mode == SOLVE_DFPN) {
+        dfpn_table_init(&g_dfpn_table, (size_t)hash_mb);
+        init_dfpn_context(&g_dfpn_ctx, &g_dfpn_table, default_book());
+    } else if (load_table) {
+        if (!init_table_from_snapshot(load_table, readonly_table)) {
+            if (input != stdin) fclose(input);
+            free_book();
+            return 1;
+        }
+    } else {
+        init_table((size_t)hash_mb);
+    }
+    if (g_mode == SOLVE_EXACT) table_set_reset_threads(default_table(), threads);
+    set_search_threads(threads);
+
+    if (stats_path) {
+        g_stats_out = strcmp(stats_path, "-") == 0 ? stdout : fopen(stats_path, "w");
+        if (!g_stats_out) {
+            fprintf(stderr, "Error: Could not create '%s'.\n", stats_path);
+            if (input != stdin) fclose(input);
+            free_tables();
+            free_book();
+            return 1;
+        }
+    }
+
+    if (batch) {
+        int status = run_batch(input);
+        if (input != stdin) fclose(input);
+        if (save_table && !table_save(default_table(), save_table)) status = 1;
+        close_stats();
+        free_tables();
+        free_book();
+        return status;
+    }
+
     GameState game;
-    if (!setup_board(&game, argv[1])) {
+    if (!setup_board(&game, positional)) {
         // Clean up on error.
-        free_table();
+        close_stats();
+        free_tables();
         free_book();
         return 1;
     }
-    
-    clock_t start = clock();
-    int score = solve(&game, false);
-    clock_t end = clock();
 
-    double time_sec = ((double)(end - start)) / CLOCKS_PER_SEC;
+    uint64_t nodes;
+    long long time_us;
+    int score = timed_solve(&game, g_guess, &nodes, &time_us);
 
     // Output results in a machine-readable format for analysis.
     fprintf(stdout, "%llu %llu %d %llu %lld\n",
             (unsigned long long)game.current_position,
             (unsigned long long)game.mask,
             score,
-            (unsigned long long)g_nodes_searched,
-            (long long)(time_sec * 1e6));
+            (unsigned long long)nodes,
+            time_us);
+    write_stats(positional);
+    if (g_report_researches) {
+        fprintf(stderr, "Info: %llu null-window re-searches.\n", (unsigned long long)g_researches);
+    }
+
+    int status = 0;
+    if (save_table && !table_save(default_table(), save_table)) status = 1;
 
     // Clean up resources.
-    free_table();
+    close_stats();
+    free_tables();
     free_book();
 
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
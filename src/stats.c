@@ -0,0 +1,72 @@
+#include "stats.h"
+
+#include <string.h>
+
+#ifdef SEARCH_STATS
+__thread SearchStats g_search_stats;
+#endif
+
+bool stats_enabled(void) {
+#ifdef SEARCH_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void stats_reset(void) {
+#ifdef SEARCH_STATS
+    memset(&g_search_stats, 0, sizeof(g_search_stats));
+#endif
+}
+
+SearchStats stats_current(void) {
+#ifdef SEARCH_STATS
+    return g_search_stats;
+#else
+    SearchStats empty;
+    memset(&empty, 0, sizeof(empty));
+    return empty;
+#endif
+}
+
+void stats_add(const SearchStats* from) {
+#ifdef SEARCH_STATS
+    // Every field is a uint64_t counter, so the structs can be added word by word.
+    uint64_t* to_words = (uint64_t*)&g_search_stats;
+    const uint64_t* from_words = (const uint64_t*)from;
+    for (size_t i = 0; i < sizeof(SearchStats) / sizeof(uint64_t); i++) {
+        to_words[i] += from_words[i];
+    }
+#else
+    (void)from;
+#endif
+}
+
+// Writes a named array of counters, up to the last non-zero one.
+static void write_array(FILE* out, const char* name, const uint64_t* values, int count) {
+    int used = count;
+    while (used > 0 && values[used - 1] == 0) used--;
+    fprintf(out, ", \"%s\": [", name);
+    for (int i = 0; i < used; i++) {
+        fprintf(out, "%s%llu", i ? ", " : "", (unsigned long long)values[i]);
+    }
+    fprintf(out, "]");
+}
+
+void stats_write_json(FILE* out, const char* position, const SearchStats* stats) {
+    fprintf(out, "{");
+    if (position) fprintf(out, "\"position\": \"%s\", ", position);
+    fprintf(out, "\"nodes\": %llu, \"cutoffs\": %llu, \"tt_probes\": %llu, \"tt_hits\": %llu, "
+                 "\"tt_cutoffs\": %llu, \"tt_stores\": %llu, \"tt_overwrites\": %llu, \"etc_cutoffs\": %llu, "
+                 "\"book_hits\": %llu, \"researches\": %llu",
+            (unsigned long long)stats->nodes, (unsigned long long)stats->cutoffs,
+            (unsigned long long)stats->tt_probes, (unsigned long long)stats->tt_hits,
+            (unsigned long long)stats->tt_cutoffs, (unsigned long long)stats->tt_stores,
+            (unsigned long long)stats->tt_overwrites, (unsigned long long)stats->etc_cutoffs,
+            (unsigned long long)stats->book_hits, (unsigned long long)stats->researches);
+    write_array(out, "cutoffs_by_index", stats->cutoffs_by_index, WIDTH);
+    write_array(out, "nodes_by_ply", stats->nodes_by_ply, STATS_PLIES);
+    write_array(out, "cutoffs_by_ply", stats->cutoffs_by_ply, STATS_PLIES);
+    fprintf(out, "}\n");
+}
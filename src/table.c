@@ -1,5 +1,6 @@
 #include "table.h"
 #include "bitboard.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -7,130 +8,533 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-// A hint to the compiler that a condition is likely to be true, for optimization.
-#define LIKELY(x) __builtin_expect(!!(x), 1)
-
-// Log2 of the table size.
-#define LOG_SIZE 23
 // Number of bits in the board key.
 #define KEY_SIZE (WIDTH * PHEIGHT)
 // Number of bits needed for the encoded score value.
 #define VALUE_SIZE 7
 
-// The type for the truncated key stored in the table.
-typedef uint32_t board_key_t;
+// Log2 of the number of entries per bucket. A bucket fills exactly one cache line.
+#define LOG_BUCKET_SIZE 3
+#define BUCKET_SIZE (1 << LOG_BUCKET_SIZE)
+#define CACHE_LINE_SIZE 64
+
+// Layout of a packed 64-bit entry, from the least significant bit:
+//   [0, 8)   encoded score value (0 marks an empty entry)
+//   [8, 14)  number of moves played in the position, used for replacement
+//   [14, 18) best move: 0 if unknown, otherwise the column plus one
+//   [18, 24) generation of the search that stored the entry
+//   [24, 64) check: the hashed key bits not implied by the bucket index
+#define VALUE_BITS 8
+#define MOVES_SHIFT 8
+#define MOVES_BITS 6
+#define BEST_MOVE_SHIFT 14
+#define BEST_MOVE_BITS 4
+#define GENERATION_SHIFT 18
+#define GENERATION_BITS 6
+#define CHECK_SHIFT 24
+#define CHECK_BITS (64 - CHECK_SHIFT)
+#define VALUE_MASK ((1u << VALUE_BITS) - 1)
+#define MOVES_MASK ((1u << MOVES_BITS) - 1)
+#define BEST_MOVE_MASK ((1u << BEST_MOVE_BITS) - 1)
+#define GENERATION_MASK ((1u << GENERATION_BITS) - 1)
+// Number of distinct generations. Once they are used up, the table is cleared for real.
+#define NUM_GENERATIONS (1u << GENERATION_BITS)
+
+// Odd multiplier used to hash keys. Multiplication by an odd number modulo 2^KEY_SIZE
+// is a bijection, so the bucket index and the check together identify the key exactly.
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+// Bounds on log2 of the number of buckets. The bucket index must cover every key
+// bit that does not fit in the check field.
+#define MIN_LOG_BUCKETS (KEY_SIZE - CHECK_BITS)
+#define MAX_LOG_BUCKETS 34
+
+// Tables at least this large are backed by huge pages where possible.
+#define HUGE_PAGE_SIZE (2u << 20)
+// Stride of the writes that fault in mapped storage: the smallest page size.
+#define PREFAULT_STRIDE 4096u
+// Tables smaller than this are always cleared by a single thread.
+#define PARALLEL_RESET_MIN_BYTES (64u << 20)
+// Maximum number of threads used to clear a table.
+#define MAX_RESET_THREADS 64
+
+// Identifies a table snapshot file and the version of its layout. The version must
+// change whenever the entry layout, the key hash or the score encoding changes.
+#define SNAPSHOT_MAGIC "C4TTSNAP"
+#define SNAPSHOT_VERSION 3
+
 // The type for the encoded score value.
 typedef uint8_t board_value_t;
+// The type for a table entry: the key check, value and depth packed into one word,
+// so that entries can be read and written atomically without locks.
+typedef uint64_t table_entry_t;
+
+// A group of entries sharing one cache line. Keys hashing to the bucket may be
+// stored in any of its entries.
+typedef struct TableBucket {
+    table_entry_t entries[BUCKET_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE))) TableBucket;
+
+// Header of a snapshot file. It fills one cache line so that the buckets that
+// follow it stay aligned when the file is mapped.
+typedef struct {
+    char magic[8];        // SNAPSHOT_MAGIC, without a terminator
+    uint32_t version;     // SNAPSHOT_VERSION
+    uint32_t width;       // WIDTH of the board the table was built for
+    uint32_t height;      // HEIGHT of the board the table was built for
+    int32_t min_score;    // MIN_SCORE, which defines the score encoding
+    int32_t max_score;    // MAX_SCORE, which defines the score encoding
+    uint32_t log_buckets; // Log2 of the number of buckets
+    uint32_t generation;  // Generation of the table when it was saved
+    uint32_t visible_generations; // Number of generations whose entries were visible
+    uint8_t reserved[24];
+} SnapshotHeader;
 
-// Assert that board_key_t can hold the truncated key.
-_Static_assert(sizeof(board_key_t) * CHAR_BIT >= (KEY_SIZE - LOG_SIZE),
-               "board_key_t type is not large enough for the configured key size.");
 // Assert that board_value_t can hold the encoded score.
 _Static_assert(sizeof(board_value_t) * CHAR_BIT >= VALUE_SIZE,
                "board_value_t type is not large enough for the configured value size.");
+// Assert that a bucket fills exactly one cache line.
+_Static_assert(sizeof(TableBucket) == CACHE_LINE_SIZE, "A bucket must fill exactly one cache line.");
+// Assert that the move count field can hold any number of moves.
+_Static_assert(WIDTH * HEIGHT < (1 << MOVES_BITS), "The moves field is too small for the board size.");
+// Assert that the best move field can hold any column plus one.
+_Static_assert(WIDTH < (1 << BEST_MOVE_BITS), "The best move field is too small for the board width.");
+// Assert that the generation field fits below the check.
+_Static_assert(GENERATION_SHIFT + GENERATION_BITS <= CHECK_SHIFT, "The generation field overlaps the check.");
+// Assert that the snapshot header keeps the buckets cache-line aligned.
+_Static_assert(sizeof(SnapshotHeader) == CACHE_LINE_SIZE, "The snapshot header must fill one cache line.");
+// Assert that a table of the maximum size can still be indexed by the key bits.
+_Static_assert(MAX_LOG_BUCKETS <= KEY_SIZE, "The maximum table size exceeds the key size.");
 
+// A table may be shared between search threads. Every entry is accessed with a
+// single relaxed atomic load or store, so a reader sees either the old or the
+// new entry, never a torn mix of one key and another key's value.
 
-static board_key_t* K_table;
-static board_value_t* V_table;
-static size_t table_size;
+// The table used by solve() and find_best_move().
+static TransTable g_default_table;
 
-// Checks if a number is prime using an optimized trial division.
-static bool is_prime(uint64_t n) {
-    if (n <= 1) return false;
-    if (n <= 3) return true;
-    if (n % 2 == 0 || n % 3 == 0) return false;
+// If true, mapped table storage is faulted in when it is allocated rather than on first use.
+static bool g_prefault = false;
 
-    for (uint64_t i = 5; i * i <= n; i = i + 6) {
-        if (n % i == 0 || n % (i + 2) == 0) {
-            return false;
-        }
-    }
-    return true;
+// Hashes a key with a bijection on KEY_SIZE bits.
+static inline uint64_t hash_key(uint64_t key) {
+    return (key * HASH_MULTIPLIER) & ((1ULL << KEY_SIZE) - 1);
+}
+
+// Returns the bucket for a hashed key. The top bits of the hash select the bucket.
+static inline TableBucket* get_bucket(const TransTable* table, uint64_t hash) {
+    return &table->buckets[hash >> table->index_shift];
 }
 
-// Finds the smallest prime number greater than or equal to n.
-static uint64_t find_next_prime(uint64_t n) {
-    if (n % 2 == 0) n++; // Start with an odd number.
-    while (true) {
-        if (is_prime(n)) return n;
-        n += 2; // Check next odd number.
+// Returns the bits of a hashed key that are stored in its entry.
+static inline uint64_t get_check(const TransTable* table, uint64_t hash) {
+    return hash & ((1ULL << table->index_shift) - 1);
+}
+
+// Returns how many generations ago an entry was stored, 0 for the current search.
+static inline unsigned entry_age(const TransTable* table, table_entry_t entry) {
+    return (table->generation - (unsigned)(entry >> GENERATION_SHIFT)) & GENERATION_MASK;
+}
+
+// Returns log2 of the largest power-of-two bucket count fitting in the given size.
+static int log_buckets_for_size(size_t size_mb) {
+    size_t buckets = (size_mb << 20) / sizeof(TableBucket);
+    int log_buckets = 0;
+    while (log_buckets < MAX_LOG_BUCKETS && ((size_t)2 << log_buckets) <= buckets) {
+        log_buckets++;
     }
+    return log_buckets < MIN_LOG_BUCKETS ? MIN_LOG_BUCKETS : log_buckets;
 }
 
-// Computes the table index for a given key.
-static inline size_t get_index(uint64_t key) {
-    return key % table_size;
+// Sets whether mapped table storage is faulted in when it is allocated.
+void set_table_prefault(bool enabled) {
+    g_prefault = enabled;
 }
 
-// Initializes the transposition table.
-void init_table(void) {
-    // Using a prime size helps reduce collisions.
-    table_size = find_next_prime(1ULL << LOG_SIZE);
+// Allocates zeroed, cache-line-aligned storage for a table. Large tables are mapped
+// with explicit huge pages if any are reserved, or else advised to use transparent
+// huge pages, to reduce TLB misses on random probes.
+void* table_alloc_memory(size_t bytes, bool* mapped) {
+    *mapped = false;
+#if defined(MAP_ANONYMOUS)
+    if (bytes >= HUGE_PAGE_SIZE) {
+        void* memory = MAP_FAILED;
+    #if defined(MAP_HUGETLB)
+        memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    #endif
+        if (memory == MAP_FAILED) {
+            memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        #if defined(MADV_HUGEPAGE)
+            if (memory != MAP_FAILED) madvise(memory, bytes, MADV_HUGEPAGE);
+        #endif
+        }
+        if (memory != MAP_FAILED) {
+            *mapped = true;
+            if (g_prefault) {
+                // Writing zeros keeps the memory as it was, but makes the kernel back it now.
+                for (size_t offset = 0; offset < bytes; offset += PREFAULT_STRIDE) {
+                    ((volatile char*)memory)[offset] = 0;
+                }
+            }
+            return memory; // Anonymous mappings are already zeroed.
+        }
+    }
+#endif
 
+    void* memory = NULL;
 #if defined(__GNUC__) || defined(__clang__)
-    // Use posix_memalign for cache-aligned memory to improve performance.
-    const size_t alignment = 64;
-    if (posix_memalign((void**)&K_table, alignment, table_size * sizeof(board_key_t)) != 0) {
-        fprintf(stderr, "Error: posix_memalign for K_table failed.\n");
-        abort();
-    }
-    if (posix_memalign((void**)&V_table, alignment, table_size * sizeof(board_value_t)) != 0) {
-        fprintf(stderr, "Error: posix_memalign for V_table failed.\n");
-        free(K_table);
-        abort();
+    // Use posix_memalign so that every bucket occupies a single cache line.
+    if (posix_memalign(&memory, CACHE_LINE_SIZE, bytes) != 0) {
+        memory = NULL;
     }
 #else
     // Fall back to standard malloc for other compilers.
-    K_table = (board_key_t*)malloc(table_size * sizeof(board_key_t));
-    if (K_table == NULL) {
-        fprintf(stderr, "Error: malloc for K_table failed.\n");
-        abort();
+    memory = malloc(bytes);
+#endif
+    if (memory != NULL) {
+        memset(memory, 0, bytes);
     }
-    V_table = (board_value_t*)malloc(table_size * sizeof(board_value_t));
-    if (V_table == NULL) {
-        fprintf(stderr, "Error: malloc for V_table failed.\n");
-        free(K_table);
+    return memory;
+}
+
+// Initializes a transposition table.
+void table_init(TransTable* table, size_t size_mb) {
+    assert(table != NULL);
+    // A power-of-two bucket count lets the index be taken with a shift instead of a division.
+    int log_buckets = log_buckets_for_size(size_mb);
+    table->num_buckets = (size_t)1 << log_buckets;
+    table->index_shift = KEY_SIZE - log_buckets;
+    table->map_offset = 0;
+    table->read_only = false;
+    table->reset_threads = 1;
+    table->generation = 0;
+    table->visible_generations = 1;
+
+    table->buckets = (TableBucket*)table_alloc_memory(table_bytes(table), &table->mapped);
+    if (table->buckets == NULL) {
+        fprintf(stderr, "Error: Failed to allocate a %zu MB transposition table.\n", table_bytes(table) >> 20);
         abort();
     }
+}
+
+// Sets the number of threads used to clear the table.
+void table_set_reset_threads(TransTable* table, int threads) {
+    assert(table != NULL);
+    if (threads < 1) threads = 1;
+    if (threads > MAX_RESET_THREADS) threads = MAX_RESET_THREADS;
+    table->reset_threads = threads;
+}
+
+// Returns the size of the table's storage in bytes.
+size_t table_bytes(const TransTable* table) {
+    return table->num_buckets * sizeof(TableBucket);
+}
+
+// A slice of a table cleared by one thread.
+typedef struct {
+    char* start;
+    size_t bytes;
+} ResetSlice;
+
+// Clears one slice of a table.
+static void* reset_slice_main(void* arg) {
+    ResetSlice* slice = (ResetSlice*)arg;
+    memset(slice->start, 0, slice->bytes);
+    return NULL;
+}
+
+// Clears all entries in a transposition table, splitting large tables between threads.
+static void clear_buckets(TransTable* table) {
+    size_t bytes = table_bytes(table);
+    int threads = table->reset_threads;
+    if (threads <= 1 || bytes < PARALLEL_RESET_MIN_BYTES) {
+        memset(table->buckets, 0, bytes);
+        return;
+    }
+
+    // Slices are whole numbers of buckets; the calling thread clears the first one.
+    ResetSlice slices[MAX_RESET_THREADS];
+    pthread_t workers[MAX_RESET_THREADS];
+    size_t buckets_per_slice = table->num_buckets / threads;
+    for (int i = 0; i < threads; i++) {
+        size_t first = buckets_per_slice * i;
+        size_t count = (i == threads - 1) ? table->num_buckets - first : buckets_per_slice;
+        slices[i].start = (char*)&table->buckets[first];
+        slices[i].bytes = count * sizeof(TableBucket);
+    }
+
+    int started = 1;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, reset_slice_main, &slices[started]) != 0) {
+            break;
+        }
+    }
+    reset_slice_main(&slices[0]);
+    for (int i = started; i < threads; i++) {
+        reset_slice_main(&slices[i]); // Clear any slices whose thread could not be started.
+    }
+    for (int i = 1; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+// Starts a new generation, keeping the given number of generations visible. When the
+// generations run out, the table is cleared so that no entry can outlive a full cycle
+// and reappear as current.
+static void next_generation(TransTable* table, unsigned visible_generations) {
+    assert(table != NULL && table->buckets != NULL && table->num_buckets > 0);
+    assert(!table->read_only);
+    table->generation = (table->generation + 1) & GENERATION_MASK;
+    table->visible_generations = visible_generations;
+    if (table->generation == 0) {
+        clear_buckets(table);
+        table->visible_generations = 1;
+    }
+}
+
+// Hides all entries by starting a new generation.
+void table_reset(TransTable* table) {
+    next_generation(table, 1);
+}
+
+// Starts a new generation in which the entries of earlier ones remain visible.
+void table_age(TransTable* table) {
+    unsigned visible = table->visible_generations + 1;
+    next_generation(table, visible < NUM_GENERATIONS ? visible : NUM_GENERATIONS);
+}
+
+// Frees memory allocated by table_alloc_memory(), or a mapping of the given size.
+void table_free_memory(void* memory, size_t bytes, bool mapped) {
+    if (mapped) {
+#if defined(MAP_ANONYMOUS)
+        munmap(memory, bytes);
 #endif
-    reset_table();
+    } else {
+        free(memory);
+    }
 }
 
-// Clears all entries in the transposition table.
-void reset_table(void) {
-    assert(K_table != NULL && V_table != NULL && table_size > 0);
-    memset(K_table, 0, table_size * sizeof(board_key_t));
-    memset(V_table, 0, table_size * sizeof(board_value_t));
+// Frees the memory used by a transposition table.
+void table_free(TransTable* table) {
+    assert(table != NULL);
+    table_free_memory((char*)table->buckets - table->map_offset, table->map_offset + table_bytes(table),
+                      table->mapped);
+    table->buckets = NULL;
+    table->num_buckets = 0;
+    table->mapped = false;
+    table->map_offset = 0;
+    table->read_only = false;
 }
 
-// Frees the memory used by the transposition table.
-void free_table(void) {
-    free(K_table);
-    free(V_table);
-    K_table = NULL;
-    V_table = NULL;
-    table_size = 0;
+// Fills in the snapshot header describing a table with 2^log_buckets buckets. The
+// generation fields are left to the caller.
+static void fill_snapshot_header(SnapshotHeader* header, uint32_t log_buckets) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->width = WIDTH;
+    header->height = HEIGHT;
+    header->min_score = MIN_SCORE;
+    header->max_score = MAX_SCORE;
+    header->log_buckets = log_buckets;
+}
+
+// Writes the table to a snapshot file.
+bool table_save(const TransTable* table, const char* filename) {
+    assert(table != NULL && table->buckets != NULL);
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not create table snapshot '%s'.\n", filename);
+        return false;
+    }
+
+    SnapshotHeader header;
+    fill_snapshot_header(&header, (uint32_t)(KEY_SIZE - table->index_shift));
+    header.generation = table->generation;
+    header.visible_generations = table->visible_generations;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(table->buckets, sizeof(TableBucket), table->num_buckets, file) == table->num_buckets;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write table snapshot '%s'.\n", filename);
+    }
+    return ok;
 }
 
-// Stores a key-value pair in the table, overwriting any existing entry at the index.
-void table_put(uint64_t key, board_value_t value) {
+// Maps a snapshot file as the storage of a table.
+bool table_load(TransTable* table, const char* filename, bool read_only) {
+    assert(table != NULL);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not open table snapshot '%s'.\n", filename);
+        return false;
+    }
+
+    SnapshotHeader header, expected;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        fprintf(stderr, "Error: Could not read table snapshot '%s'.\n", filename);
+        close(fd);
+        return false;
+    }
+
+    // The snapshot must have been built for the same board, encoding and a valid size.
+    uint32_t log_buckets = header.log_buckets;
+    bool valid_size = log_buckets >= MIN_LOG_BUCKETS && log_buckets <= MAX_LOG_BUCKETS &&
+                      (uint64_t)st.st_size == sizeof(header) + ((uint64_t)sizeof(TableBucket) << log_buckets);
+    fill_snapshot_header(&expected, log_buckets);
+    expected.generation = header.generation;
+    expected.visible_generations = header.visible_generations;
+    bool valid_generation = header.generation < NUM_GENERATIONS &&
+                            header.visible_generations >= 1 && header.visible_generations <= NUM_GENERATIONS;
+    if (!valid_size || !valid_generation || memcmp(&header, &expected, sizeof(header)) != 0) {
+        fprintf(stderr, "Error: '%s' is not a compatible table snapshot.\n", filename);
+        close(fd);
+        return false;
+    }
+
+    // A private mapping never writes changes back to the file.
+    int protection = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* memory = mmap(NULL, (size_t)st.st_size, protection, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map table snapshot '%s'.\n", filename);
+        return false;
+    }
+
+    table->buckets = (TableBucket*)((char*)memory + sizeof(header));
+    table->num_buckets = (size_t)1 << log_buckets;
+    table->index_shift = KEY_SIZE - (int)log_buckets;
+    table->mapped = true;
+    table->map_offset = sizeof(header);
+    table->read_only = read_only;
+    table->reset_threads = 1;
+    table->generation = header.generation;
+    table->visible_generations = header.visible_generations;
+    return true;
+}
+
+// Stores a key-value pair and best move in the key's bucket. An existing entry for
+// the key is updated in place; otherwise an empty or hidden entry is used, or failing
+// that the entry of an older generation, or of the deepest position, is replaced.
+void table_put(TransTable* table, uint64_t key, board_value_t value, int moves, int best_move) {
     assert(key >> KEY_SIZE == 0);
     assert(value != 0); // 0 is reserved for "not found".
+    assert(moves >= 0 && moves <= WIDTH * HEIGHT);
+    assert(best_move >= -1 && best_move < WIDTH);
+
+    if (table->read_only) return;
+
+    uint64_t hash = hash_key(key);
+    uint64_t check = get_check(table, hash);
+    TableBucket* bucket = get_bucket(table, hash);
 
-    size_t pos = get_index(key);
-    K_table[pos] = (board_key_t)key; // Store truncated key to detect some collisions.
-    V_table[pos] = value;
+    // Entries are ranked by age, then by depth; a hidden entry outranks them all.
+    int victim = 0;
+    int victim_rank = -1;
+    bool found_hidden = false;
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        table_entry_t entry = __atomic_load_n(&bucket->entries[i], __ATOMIC_RELAXED);
+        if ((entry >> CHECK_SHIFT) == check) {
+            victim = i; // Same position, possibly from an earlier generation.
+            break;
+        }
+        if ((entry & VALUE_MASK) == 0) {
+            if (!found_hidden) victim = i; // Empty, and so is the rest of the bucket.
+            break;
+        }
+        unsigned age = entry_age(table, entry);
+        if (age >= table->visible_generations) {
+            // Hidden, but keep looking for the key so that it is never stored twice.
+            if (!found_hidden) victim = i;
+            found_hidden = true;
+            continue;
+        }
+        int rank = (int)((age << MOVES_BITS) | ((entry >> MOVES_SHIFT) & MOVES_MASK));
+        if (!found_hidden && rank > victim_rank) {
+            victim = i;
+            victim_rank = rank;
+        }
+    }
+
+#ifdef SEARCH_STATS
+    table_entry_t replaced = __atomic_load_n(&bucket->entries[victim], __ATOMIC_RELAXED);
+    STATS_INC(tt_stores);
+    if ((replaced & VALUE_MASK) != 0 && (replaced >> CHECK_SHIFT) != check &&
+        entry_age(table, replaced) < table->visible_generations) {
+        STATS_INC(tt_overwrites);
+    }
+#endif
+
+    table_entry_t entry = (check << CHECK_SHIFT) | ((table_entry_t)table->generation << GENERATION_SHIFT) |
+                          ((table_entry_t)(best_move + 1) << BEST_MOVE_SHIFT) |
+                          ((table_entry_t)moves << MOVES_SHIFT) | value;
+    __atomic_store_n(&bucket->entries[victim], entry, __ATOMIC_RELAXED);
 }
 
-// Retrieves a value from the table for a given key.
-board_value_t table_get(uint64_t key) {
+// Retrieves a value and best move from the table for a given key.
+board_value_t table_get(const TransTable* table, uint64_t key, int* best_move) {
     assert(key >> KEY_SIZE == 0);
 
-    size_t pos = get_index(key);
-    // Check if the stored truncated key matches the current key.
-    if (LIKELY(K_table[pos] == (board_key_t)key)) {
-        return V_table[pos];
+    uint64_t hash = hash_key(key);
+    uint64_t check = get_check(table, hash);
+    const TableBucket* bucket = get_bucket(table, hash);
+    STATS_INC(tt_probes);
+
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        table_entry_t entry = __atomic_load_n(&bucket->entries[i], __ATOMIC_RELAXED);
+        // The check and the bucket index together identify the key exactly. Entries
+        // of hidden generations are treated as absent.
+        if ((entry >> CHECK_SHIFT) == check && entry_age(table, entry) < table->visible_generations) {
+            if (best_move) *best_move = (int)((entry >> BEST_MOVE_SHIFT) & BEST_MOVE_MASK) - 1;
+            STATS_INC(tt_hits);
+            return (board_value_t)(entry & VALUE_MASK);
+        }
+        // Buckets are filled in order and entries are never removed, so the rest is empty.
+        if ((entry & VALUE_MASK) == 0) break;
     }
-    return 0; // Return 0 if not found or if a collision occurred.
-}
\ No newline at end of file
+    if (best_move) *best_move = -1;
+    return 0; // Return 0 if not found.
+}
+
+// Prefetches the bucket of a key.
+void table_prefetch(const TransTable* table, uint64_t key) {
+    assert(key >> KEY_SIZE == 0);
+    __builtin_prefetch(get_bucket(table, hash_key(key)));
+}
+
+// Returns the process-wide default table.
+TransTable* default_table(void) {
+    return &g_default_table;
+}
+
+// Initializes the default transposition table.
+void init_table(size_t size_mb) {
+    table_init(&g_default_table, size_mb);
+}
+
+// Initializes the default transposition table from a snapshot file.
+bool init_table_from_snapshot(const char* filename, bool read_only) {
+    return table_load(&g_default_table, filename, read_only);
+}
+
+// Clears all entries in the default transposition table.
+void reset_table(void) {
+    table_reset(&g_default_table);
+}
+
+// Ages the entries of the default transposition table.
+void age_table(void) {
+    table_age(&g_default_table);
+}
+
+// Frees the memory used by the default transposition table.
+void free_table(void) {
+    table_free(&g_default_table);
+}
@@ -0,0 +1,30 @@
+#include "util.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Returns the current monotonic time in microseconds.
+long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Parses a decimal value, rejecting empty strings, trailing characters and overflow.
+bool parse_int_option(const char* arg, long long min, long long max, long long* value) {
+    char* end;
+    errno = 0;
+    long long number = strtoll(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || errno == ERANGE || number < min || number > max) {
+        return false;
+    }
+    *value = number;
+    return true;
+}
+
+// Parses a strictly positive integer option value, returning 0 if it is invalid.
+int parse_positive_int(const char* arg) {
+    long long value;
+    return parse_int_option(arg, 1, MAX_INT_OPTION, &value) ? (int)value : 0;
+}
@@ -0,0 +1,155 @@
+#include "weak.h"
+#include "table.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number of bits in the board key.
+#define KEY_SIZE (WIDTH * PHEIGHT)
+
+// Layout of a 32-bit entry, from the least significant bit:
+//   [0, 2)  outcome bound, one of the WEAK_BOUND_* codes
+//   [2, 32) check: the hashed key bits not implied by the bucket index
+// An entry of 0 is empty. Keys whose check is 0 are never stored, so no stored entry is 0.
+#define BOUND_BITS 2
+#define BOUND_MASK ((1u << BOUND_BITS) - 1)
+#define CHECK_BITS (32 - BOUND_BITS)
+
+// Number of entries per bucket, after the bucket's generation.
+#define WEAK_BUCKET_SIZE 15
+#define CACHE_LINE_SIZE 64
+
+// Odd multiplier used to hash keys, as in the exact solver's table.
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+// Bounds on log2 of the number of buckets. The bucket index must cover every key
+// bit that does not fit in the check field.
+#define MIN_LOG_BUCKETS (KEY_SIZE - CHECK_BITS)
+#define MAX_LOG_BUCKETS 34
+
+// A group of entries sharing one cache line. Entries are filled in order; when the
+// bucket is full, the oldest entry is dropped.
+typedef struct WeakBucket {
+    uint32_t generation; // The bucket's entries are valid only in this table generation
+    uint32_t entries[WEAK_BUCKET_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE))) WeakBucket;
+
+// Assert that a bucket fills exactly one cache line.
+_Static_assert(sizeof(WeakBucket) == CACHE_LINE_SIZE, "A weak bucket must fill exactly one cache line.");
+// Assert that the smallest table leaves no key bit unaccounted for.
+_Static_assert(((size_t)MIN_WEAK_TABLE_MB << 20) >= (sizeof(WeakBucket) << MIN_LOG_BUCKETS),
+               "MIN_WEAK_TABLE_MB is too small to identify keys exactly.");
+
+// Hashes a key with a bijection on KEY_SIZE bits.
+static inline uint64_t hash_key(uint64_t key) {
+    return (key * HASH_MULTIPLIER) & ((1ULL << KEY_SIZE) - 1);
+}
+
+// Returns the bucket for a hashed key. The top bits of the hash select the bucket.
+static inline WeakBucket* get_bucket(const WeakTable* table, uint64_t hash) {
+    return &table->buckets[hash >> table->index_shift];
+}
+
+// Returns the bits of a hashed key that are stored in its entry.
+static inline uint32_t get_check(const WeakTable* table, uint64_t hash) {
+    return (uint32_t)(hash & ((1ULL << table->index_shift) - 1));
+}
+
+// Returns the size of the table's storage in bytes.
+static size_t weak_table_bytes(const WeakTable* table) {
+    return table->num_buckets * sizeof(WeakBucket);
+}
+
+// Initializes a weak table.
+void weak_table_init(WeakTable* table, size_t size_mb) {
+    assert(table != NULL);
+    int log_buckets = MIN_LOG_BUCKETS;
+    while (log_buckets < MAX_LOG_BUCKETS && (sizeof(WeakBucket) << (log_buckets + 1)) <= (size_mb << 20)) {
+        log_buckets++;
+    }
+    table->num_buckets = (size_t)1 << log_buckets;
+    table->index_shift = KEY_SIZE - log_buckets;
+    table->generation = 1; // Zeroed buckets belong to generation 0, so they start out empty.
+
+    table->buckets = (WeakBucket*)table_alloc_memory(weak_table_bytes(table), &table->mapped);
+    if (table->buckets == NULL) {
+        fprintf(stderr, "Error: Failed to allocate a %zu MB weak table.\n", weak_table_bytes(table) >> 20);
+        abort();
+    }
+}
+
+// Clears the table by starting a new generation. Buckets are only wiped for real when
+// the counter wraps around.
+void weak_table_reset(WeakTable* table) {
+    assert(table != NULL && table->buckets != NULL);
+    if (++table->generation == 0) {
+        memset(table->buckets, 0, weak_table_bytes(table));
+        table->generation = 1;
+    }
+}
+
+// Frees the memory used by a weak table.
+void weak_table_free(WeakTable* table) {
+    assert(table != NULL);
+    table_free_memory(table->buckets, weak_table_bytes(table), table->mapped);
+    table->buckets = NULL;
+    table->num_buckets = 0;
+}
+
+// Retrieves the outcome bound stored for a key, or returns -1 if there is none.
+int weak_table_get(const WeakTable* table, uint64_t key) {
+    uint64_t hash = hash_key(key);
+    uint32_t check = get_check(table, hash);
+    const WeakBucket* bucket = get_bucket(table, hash);
+    if (bucket->generation != table->generation) return -1;
+
+    for (int i = 0; i < WEAK_BUCKET_SIZE; i++) {
+        uint32_t entry = bucket->entries[i];
+        if (entry == 0) break; // The rest of the bucket is empty.
+        if ((entry >> BOUND_BITS) == check) return (int)(entry & BOUND_MASK);
+    }
+    return -1;
+}
+
+// Stores an outcome bound for a key, replacing any earlier bound for it.
+void weak_table_put(WeakTable* table, uint64_t key, int bound) {
+    uint64_t hash = hash_key(key);
+    uint32_t check = get_check(table, hash);
+    if (check == 0) return; // Its entry could not be told apart from an empty one.
+    WeakBucket* bucket = get_bucket(table, hash);
+    if (bucket->generation != table->generation) {
+        memset(bucket->entries, 0, sizeof(bucket->entries));
+        bucket->generation = table->generation;
+    }
+
+    uint32_t entry = (check << BOUND_BITS) | (uint32_t)bound;
+    int i = 0;
+    for (; i < WEAK_BUCKET_SIZE; i++) {
+        uint32_t stored = bucket->entries[i];
+        if (stored == 0 || (stored >> BOUND_BITS) == check) {
+            bucket->entries[i] = entry;
+            return;
+        }
+    }
+    // The bucket is full: drop the oldest entry.
+    memmove(&bucket->entries[0], &bucket->entries[1], (WEAK_BUCKET_SIZE - 1) * sizeof(uint32_t));
+    bucket->entries[WEAK_BUCKET_SIZE - 1] = entry;
+}
+
+// Prefetches the bucket of a key.
+void weak_table_prefetch(const WeakTable* table, uint64_t key) {
+    __builtin_prefetch(get_bucket(table, hash_key(key)));
+}
+
+void init_weak_context(WeakContext* ctx, WeakTable* table, const Book* book) {
+    assert(ctx != NULL && table != NULL);
+    ctx->table = table;
+    ctx->book = book;
+    ctx->nodes = 0;
+    // Check center columns first, which are generally stronger.
+    for (int i = 0; i < WIDTH; i++) {
+        ctx->column_order[i] = WIDTH / 2 + (1 - 2 * (i % 2)) * ((i + 1) / 2);
+    }
+}